@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "readsim.h"
+
+using namespace std;
+
+// Throughput benchmark for the annotation engines.
+//
+// For every model, read length and mutation rate a reproducible read set is
+// simulated (read ii always comes from stream ii of the seed) and every
+// engine annotates it. Results are printed as JSON, one result per line, so
+// that a previous run can be handed back with -b as a baseline.
+//
+// The banded engine is handed its bands from the simulated read's true
+// path, as an oracle would; its rate is what banding buys once seeding has
+// found the diagonals, not what seeding plus banding costs. Its results say
+// so ("hints": "true path").
+
+typedef list<string> (*Engine)(HMM&, const simulated_read&, search_stats*);
+
+typedef struct {
+    const char *name;
+    Engine run;
+    const char *hints;      // where its bands come from
+} engine_entry;
+
+// Half-width of the bands handed to the banded engine.
+#define BENCH_BAND_WIDTH 8
+
+static list<string> viterbiEngine(HMM &h, const simulated_read &read, search_stats *stats){
+    return h.annotate(read.seq.c_str(), NULL, stats);
+}
+
+// Bands of width around the read's true diagonals: every state on its path
+// is hinted at the diagonal annotate puts its first base on (annotate
+// ignores hints for states that aren't indexed).
+static void trueBands(const simulated_read &read, int width, vector<search_band> &bands){
+    bands.clear();
+    set<int> seen;
+    for( unsigned int ii = 0; ii < read.path.size(); ii++ ){
+        if( seen.insert(read.path[ii]).second ){
+            search_band b = {read.path[ii], read.diagonals[ii], width};
+            bands.push_back(b);
+        }
+    }
+}
+
+// Viterbi banded on the true diagonals, standing in for seed chaining.
+static list<string> bandedEngine(HMM &h, const simulated_read &read, search_stats *stats){
+    vector<search_band> bands;
+    trueBands(read, BENCH_BAND_WIDTH, bands);
+    return h.annotate(read.seq.c_str(), NULL, stats, &bands);
+}
+
+static engine_entry ENGINES[] = {
+    { "viterbi", viterbiEngine, "none" },
+    { "banded", bandedEngine, "true path" },
+};
+
+#define NUM_ENGINES ((int) (sizeof(ENGINES) / sizeof(ENGINES[0])))
+
+typedef struct {
+    string model;
+    string engine;
+    string hints;
+    int length;
+    double mutation;
+    int reads;
+    long bases;
+    double seconds;
+    double expansions;
+    int peakQueue;
+    long peakRss;
+} bench_result;
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long peakRss(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // kilobytes on linux
+}
+
+static vector<string> split(const char *s){
+    vector<string> res;
+    string cur;
+    for( ; *s; s++ ){
+        if( *s == ',' ){
+            res.push_back(cur);
+            cur = "";
+        } else {
+            cur.push_back(*s);
+        }
+    }
+    if( cur.size() ){
+        res.push_back(cur);
+    }
+    return res;
+}
+
+static string resultKey(const string &model, const string &engine, int length, double mutation){
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s|%s|%d|%g", model.c_str(), engine.c_str(), length, mutation);
+    return string(buf);
+}
+
+// Pull "key": value out of a single-line JSON object.
+static bool jsonField(const char *line, const char *key, string &value){
+    string pattern = string("\"") + key + "\":";
+    const char *p = strstr(line, pattern.c_str());
+    if( !p ){
+        return false;
+    }
+    p += pattern.size();
+    while( *p == ' ' ){ p++; }
+
+    value = "";
+    if( *p == '"' ){
+        for( p++; *p && *p != '"'; p++ ){ value.push_back(*p); }
+    } else {
+        for( ; *p && *p != ',' && *p != '}'; p++ ){ value.push_back(*p); }
+    }
+    return true;
+}
+
+static map<string, double> readBaseline(const char *fn){
+    map<string, double> baseline;
+    FILE *fp = fopen(fn, "r");
+    if( !fp ){
+        fprintf(stderr, "Could not open baseline %s\n", fn);
+        exit(1);
+    }
+
+    char line[4096];
+    while( fgets(line, sizeof(line), fp) ){
+        string model, engine, length, mutation, rate;
+        if( jsonField(line, "model", model) && jsonField(line, "engine", engine) &&
+            jsonField(line, "length", length) && jsonField(line, "mutation", mutation) &&
+            jsonField(line, "reads_per_sec", rate) ){
+            baseline[resultKey(model, engine, atoi(length.c_str()), atof(mutation.c_str()))] = atof(rate.c_str());
+        }
+    }
+    fclose(fp);
+    return baseline;
+}
+
+// Reads whose search fell back from width 0 bands on their true path. The
+// true path is always in band, so any is a hint off its diagonal.
+static int bandFallbacks(HMM &h, const vector<simulated_read> &reads){
+    int n = 0;
+    vector<search_band> bands;
+    for( unsigned int ii = 0; ii < reads.size(); ii++ ){
+        search_stats stats;
+        trueBands(reads[ii], 0, bands);
+        h.annotate(reads[ii].seq.c_str(), NULL, &stats, &bands);
+        n += stats.fellBack;
+    }
+    return n;
+}
+
+static void printResult(FILE *out, bench_result &r, bool last){
+    fprintf(out, "    {\"model\": \"%s\", \"engine\": \"%s\", \"hints\": \"%s\", \"length\": %d, \"mutation\": %g, "
+                 "\"reads\": %d, \"seconds\": %.6f, \"reads_per_sec\": %.3f, \"ns_per_base\": %.1f, "
+                 "\"expansions_per_read\": %.1f, \"peak_queue\": %d, \"peak_rss_kb\": %ld}%s\n",
+            r.model.c_str(), r.engine.c_str(), r.hints.c_str(), r.length, r.mutation,
+            r.reads, r.seconds, r.reads / r.seconds, r.seconds * 1e9 / r.bases,
+            r.expansions / r.reads, r.peakQueue, r.peakRss, (last ? "" : ","));
+}
+
+int main(int argc, char* argv[]){
+
+    const char *models = "models/casino.xml,models/simple.xml,models/complex.xml";
+    const char *lengths = "50,100";
+    const char *mutations = "0,0.02,0.05";
+    const char *baselineFile = NULL;
+    const char *outFile = NULL;
+    int reads = 10;
+    unsigned long seed = 1;
+    double threshold = 5.0;
+
+    int c;
+    while( (c = getopt(argc, argv, "m:l:u:n:s:b:t:o:h")) != -1 ){
+        switch( c ){
+            case 'm': models = optarg; break;
+            case 'l': lengths = optarg; break;
+            case 'u': mutations = optarg; break;
+            case 'n': reads = atoi(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 10); break;
+            case 'b': baselineFile = optarg; break;
+            case 't': threshold = atof(optarg); break;
+            case 'o': outFile = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-m models] [-l lengths] [-u mutation rates] [-n reads]\n"
+                                "          [-s seed] [-o out.json] [-b baseline.json] [-t max regression %%]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    vector<string> modelList = split(models);
+    vector<string> lengthList = split(lengths);
+    vector<string> mutationList = split(mutations);
+    vector<bench_result> results;
+
+    for( unsigned int mm = 0; mm < modelList.size(); mm++ ){
+        HMM h(modelList[mm].c_str());
+
+        for( unsigned int ll = 0; ll < lengthList.size(); ll++ ){
+            for( unsigned int uu = 0; uu < mutationList.size(); uu++ ){
+
+                int length = atoi(lengthList[ll].c_str());
+                double mutation = atof(mutationList[uu].c_str());
+
+                ReadSimulator sim(&h, QualityModel(), seed, mutation);
+                vector<simulated_read> readSet(reads);
+                long bases = 0;
+                for( int ii = 0; ii < reads; ii++ ){
+                    sim.simulate(readSet[ii], ii, length);
+                    bases += readSet[ii].seq.size();
+                }
+
+                int fallbacks = bandFallbacks(h, readSet);
+                if( fallbacks ){
+                    fprintf(stderr, "%s length %d mutation %g: %d of %d reads fell back from bands on their true path\n",
+                            modelList[mm].c_str(), length, mutation, fallbacks, reads);
+                    return 1;
+                }
+
+                for( int ee = 0; ee < NUM_ENGINES; ee++ ){
+                    bench_result r;
+                    r.model = modelList[mm];
+                    r.engine = ENGINES[ee].name;
+                    r.hints = ENGINES[ee].hints;
+                    r.length = length;
+                    r.mutation = mutation;
+                    r.reads = reads;
+                    r.bases = bases;
+                    r.expansions = 0.0;
+                    r.peakQueue = 0;
+
+                    double start = now();
+                    for( int ii = 0; ii < reads; ii++ ){
+                        search_stats stats;
+                        ENGINES[ee].run(h, readSet[ii], &stats);
+                        r.expansions += stats.searched;
+                        if( stats.peakQueue > r.peakQueue ){
+                            r.peakQueue = stats.peakQueue;
+                        }
+                    }
+                    r.seconds = now() - start;
+                    r.peakRss = peakRss();
+
+                    fprintf(stderr, "%s %s length %d mutation %g: %.1f reads/sec\n",
+                            r.model.c_str(), r.engine.c_str(), length, mutation, r.reads / r.seconds);
+                    results.push_back(r);
+                }
+            }
+        }
+    }
+
+    FILE *out = stdout;
+    if( outFile && !(out = fopen(outFile, "w")) ){
+        fprintf(stderr, "Could not open %s for writing\n", outFile);
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"seed\": %lu,\n  \"queue\": \"%s\",\n  \"results\": [\n", seed, SEARCH_QUEUE_NAME);
+    for( unsigned int ii = 0; ii < results.size(); ii++ ){
+        printResult(out, results[ii], ii + 1 == results.size());
+    }
+    fprintf(out, "  ]\n}\n");
+
+    if( out != stdout ){
+        fclose(out);
+    }
+
+    if( !baselineFile ){
+        return 0;
+    }
+
+    // Compare against the baseline; any configuration that slowed down by
+    // more than threshold percent fails the run.
+    map<string, double> baseline = readBaseline(baselineFile);
+    int regressions = 0;
+    for( unsigned int ii = 0; ii < results.size(); ii++ ){
+        bench_result &r = results[ii];
+        map<string, double>::iterator b_itr = baseline.find(resultKey(r.model, r.engine, r.length, r.mutation));
+        if( b_itr == baseline.end() ){
+            continue;
+        }
+        double rate = r.reads / r.seconds;
+        double change = 100.0 * (rate - b_itr->second) / b_itr->second;
+        if( change < -threshold ){
+            fprintf(stderr, "REGRESSION %s %s length %d mutation %g: %.1f -> %.1f reads/sec (%.1f%%)\n",
+                    r.model.c_str(), r.engine.c_str(), r.length, r.mutation, b_itr->second, rate, change);
+            regressions++;
+        }
+    }
+
+    if( regressions ){
+        fprintf(stderr, "%d configuration(s) regressed by more than %g%%\n", regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+#ifndef _COLUMNS_H_
+#define _COLUMNS_H_
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "nucleotide.h"
+#include "parallel.h"
+
+// ColumnCounts
+//   Per column tallies over the rows of an alignment: how many rows have an
+//   A, T, C, G, or anything else (gaps, Ns) there. A row is added or removed
+//   in O(L), and everything the seeding layer takes from an alignment (its
+//   gaps, consensus and concordant bits under an encoding) follows from the
+//   tallies in O(L), without another pass over the rows. A row that isn't
+//   as long as the ones already counted is refused, with an error.
+
+// Per column counts: A, T, C, G, then gaps and anything else.
+#define MSA_BASES 5
+
+class ColumnCounts {
+    public:
+        ColumnCounts() : _rows(0) {}
+        bool add(const std::string &row){ return tally(row, 1); }
+        bool remove(const std::string &row){ return tally(row, -1); }
+        bool count(const std::vector<const std::string*>&, int = 1);
+        void clear(){ _counts.clear(); _rows = 0; }
+        bool empty() const { return _rows == 0; }
+        int rows() const { return _rows; }
+        size_t columns() const { return _counts.size() / MSA_BASES; }
+        const int* column(size_t c) const { return &_counts[MSA_BASES * c]; }
+        int present(size_t) const;
+        void derive(const int*, std::vector<uint64_t>*, std::vector<uint64_t>*, std::vector<uint64_t>*) const;
+        static const unsigned char* bases();
+    private:
+        bool tally(const std::string&, int);
+        std::vector<int> _counts;
+        int _rows;
+};
+
+// Base index (0-3 for A, T, C, G in either case, MSA_BASES - 1 otherwise)
+// of every character.
+inline const unsigned char* ColumnCounts::bases(){
+    return nucleotideIndex();
+}
+
+inline bool ColumnCounts::tally(const std::string &row, int n){
+    if( _rows && row.size() != columns() ){
+        fprintf(stderr, "A row of %lu columns doesn't fit an alignment of %lu\n", (unsigned long) row.size(), (unsigned long) columns());
+        return false;
+    }
+    if( _counts.empty() ){
+        _counts.assign(MSA_BASES * row.size(), 0);
+    }
+
+    if( !row.empty() ){
+        const unsigned char *base = bases();
+        int *counts = &_counts[0];
+        for( size_t ii = 0; ii < row.size(); ii++ ){
+            counts[MSA_BASES * ii + base[(unsigned char) row[ii]]] += n;
+        }
+    }
+
+    _rows += n;
+    assert( _rows >= 0 );
+    if( _rows == 0 ){
+        _counts.clear();
+    }
+    return true;
+}
+
+typedef struct {
+    const std::vector<const std::string*> *rows;
+    int *counts;
+} column_task;
+
+// Count the bases in columns [begin, end) of every row.
+inline void countColumnBlock(int begin, int end, void *arg){
+    column_task *task = (column_task*) arg;
+    const unsigned char *base = ColumnCounts::bases();
+
+    std::vector<const std::string*>::const_iterator r_itr;
+    for( r_itr = task->rows->begin(); r_itr != task->rows->end(); r_itr++ ){
+        const char *row = (*r_itr)->data();
+        for( int ii = begin; ii < end; ii++ ){
+            task->counts[MSA_BASES * ii + base[(unsigned char) row[ii]]]++;
+        }
+    }
+}
+
+// Tally a whole alignment at once, split by columns across threads. Rows
+// of different lengths leave nothing counted.
+inline bool ColumnCounts::count(const std::vector<const std::string*> &rows, int threads){
+    clear();
+    if( rows.empty() ){
+        return true;
+    }
+
+    size_t len = rows[0]->size();
+    for( size_t ii = 0; ii < rows.size(); ii++ ){
+        if( rows[ii]->size() != len ){
+            fprintf(stderr, "A row of %lu columns doesn't fit an alignment of %lu\n", (unsigned long) rows[ii]->size(), (unsigned long) len);
+            return false;
+        }
+    }
+
+    _rows = rows.size();
+    if( len == 0 ){
+        return true;
+    }
+    _counts.assign(MSA_BASES * len, 0);
+
+    column_task task;
+    task.rows = &rows;
+    task.counts = &_counts[0];
+    parallelFor(len, threads, countColumnBlock, &task);
+    return true;
+}
+
+// The set of bases in column c, bit i for base i (A, T, C, G); -1 if any
+// row has something else there.
+inline int ColumnCounts::present(size_t c) const {
+    const int *n = column(c);
+    if( n[MSA_BASES - 1] ){
+        return -1;
+    }
+    return (n[0] ? 1 : 0) | (n[1] ? 2 : 0) | (n[2] ? 4 : 0) | (n[3] ? 8 : 0);
+}
+
+// Packed words, laid out as PackedSequence's, for codes[] (A, T, C, G):
+//   consensus  the AND of every row's encoding (anything but a nucleotide
+//              encoded as an A)
+//   gaps       11 under columns with a nucleotide in every row
+//   mask       the bits of the gapless columns that every row agrees on
+// Any of them may be NULL.
+inline void ColumnCounts::derive(const int *codes, std::vector<uint64_t> *consensus, std::vector<uint64_t> *gaps, std::vector<uint64_t> *mask) const {
+
+    // everything depends only on the set of codes in a column
+    uint64_t allOf[32];
+    uint64_t agreed[32];
+    for( int present = 0; present < 32; present++ ){
+        int ones = 3, zeros = 3;
+        for( int b = 0; b < MSA_BASES; b++ ){
+            if( present & (1 << b) ){
+                int code = codes[b < 4 ? b : 0];
+                ones  &= code;
+                zeros &= ~code;
+            }
+        }
+        allOf[present] = ones;
+        agreed[present] = ones | zeros;
+    }
+
+    size_t len = columns();
+    size_t words = (2 * len + 63) / 64;
+    if( consensus ){ consensus->assign(words, 0); }
+    if( gaps ){ gaps->assign(words, 0); }
+    if( mask ){ mask->assign(words, 0); }
+
+    // 32 columns to a word
+    const int *n = len ? column(0) : NULL;
+    for( size_t w = 0; w < words; w++ ){
+        uint64_t c = 0, g = 0, m = 0;
+        size_t end = (32 * (w + 1) < len ? 32 * (w + 1) : len);
+        for( size_t ii = 32 * w; ii < end; ii++, n += MSA_BASES ){
+            int present = (n[0] ? 1 : 0) | (n[1] ? 2 : 0) | (n[2] ? 4 : 0) | (n[3] ? 8 : 0) | (n[4] ? 16 : 0);
+            unsigned int shift = 2 * (ii & 31);
+            c |= allOf[present] << shift;
+            g |= (n[MSA_BASES - 1] ? 0ULL : 3ULL) << shift;
+            m |= (n[MSA_BASES - 1] ? 0ULL : agreed[present]) << shift;
+        }
+        if( consensus ){ (*consensus)[w] = c; }
+        if( gaps ){ (*gaps)[w] = g; }
+        if( mask ){ (*mask)[w] = m; }
+    }
+}
+
+#endif
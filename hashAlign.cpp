@@ -4,27 +4,65 @@
 using namespace boost;
 using namespace std;
 
-// Insert a sequence into the multiple sequence alignment
+// Insert a sequence into the multiple sequence alignment; -1 if it's not
+// as long as the rows already in, counted or not.
 int MultipleSequenceAlgn::insert(kseq_t *kseq){
   Sequence seq(kseq);
+  if( !_sequences.empty() && seq.getSeq().size() != _sequences[0].getSeq().size() ){
+    fprintf(stderr, "A row of %lu columns doesn't fit an alignment of %lu\n",
+            (unsigned long) seq.getSeq().size(), (unsigned long) _sequences[0].getSeq().size());
+    return -1;
+  }
+  if( !_columns.empty() && !_columns.add(seq.getSeq()) ){
+    return -1;
+  }
+  _names.insert(make_pair(seq.getName(), (int) _sequences.size()));
   _sequences.push_back(seq);
   _gaps.clear(); // reset the gaps;
   return _sequences.size();
 }
 
-bool MultipleSequenceAlgn::remove(string seq){
+// The last row takes the place of the one removed.
+bool MultipleSequenceAlgn::remove(const string &seq){
 
-  vector<Sequence>::iterator s_itr;
+  // the first row by that name, as a scan would find
+  pair<unordered_multimap<string, int>::iterator, unordered_multimap<string, int>::iterator> range;
+  range = _names.equal_range(seq);
+  if( range.first == range.second ){
+    return false;
+  }
+
+  unordered_multimap<string, int>::iterator n_itr = range.first;
+  unordered_multimap<string, int>::iterator first_itr;
+  for( first_itr = range.first; first_itr != range.second; first_itr++ ){
+    if( first_itr->second < n_itr->second ){
+      n_itr = first_itr;
+    }
+  }
 
-  for(s_itr = _sequences.begin(); s_itr != _sequences.end(); s_itr++){
-    if( s_itr->getName() == seq ){
-      _sequences.erase(s_itr);
-      _gaps.clear();
-      return true;
+  int row = n_itr->second;
+  int last = _sequences.size() - 1;
+  _names.erase(n_itr);
+
+  // counted again when next needed if the row doesn't fit
+  if( !_columns.empty() && !_columns.remove(_sequences[row].getSeq()) ){
+    _columns.clear();
+  }
+
+  if( row != last ){
+    range = _names.equal_range(_sequences[last].getName());
+    for( n_itr = range.first; n_itr != range.second; n_itr++ ){
+      if( n_itr->second == last ){
+        n_itr->second = row;
+        break;
+      }
     }
+    _sequences[row] = _sequences[last];
   }
+  _sequences.pop_back();
 
-  return false;
+  _gaps.clear();
+  return true;
 }
 
 dynamic_bitset<> MultipleSequenceAlgn::getGaps(){
@@ -32,60 +70,45 @@ dynamic_bitset<> MultipleSequenceAlgn::getGaps(){
     return _gaps;
   }
 
-  dynamic_bitset<> mask;
-  if( _sequences.size() ){
-    mask = _sequences[0].getMask();
-
-    vector<Sequence>::iterator s_itr = _sequences.begin() + 1;
-    for( ; s_itr != _sequences.end(); s_itr++ ){
-      mask &= s_itr->getMask();
-    }
-  }
+  int codes[] = {0,1,2,3};
+  vector<uint64_t> gaps;
+  const ColumnCounts &columns = countColumns();
+  columns.derive(codes, NULL, &gaps, NULL);
 
-  _gaps = mask;
-  return mask;
+  _gaps = packedBits(gaps, 2 * columns.columns());
+  return _gaps;
 
 }
 
-list<Hash> MultipleSequenceAlgn::makeHashes(vector<int> encoding){
+list<Hash> MultipleSequenceAlgn::makeHashes(const vector<int> &encoding, const SeedPattern &pattern){
 
-  unsigned int hash_size = 24;
+  unsigned int hash_size = pattern.width();
+  uint64_t full = (hash_size < 64 ? (1ULL << hash_size) - 1 : ~0ULL);
 
 
   list<Hash> hashes;
 
-  dynamic_bitset<> sequence = _sequences[0].encode(encoding);
-  dynamic_bitset<> gaps = getGaps();
-  dynamic_bitset<> mask = consensusWithEncoding(encoding);
-  unsigned int len = gaps.size();
+  // Under the mask every row agrees, so the consensus holds the values.
+  vector<uint64_t> consensus, gaps, mask;
+  const ColumnCounts &columns = countColumns();
+  columns.derive(&encoding[0], &consensus, &gaps, &mask);
+  unsigned int len = 2 * columns.columns();
 
-  cout << mask << endl;
-
-  assert(gaps.size() == sequence.size());
-  assert(gaps.size() == mask.size());
-
-  dynamic_bitset<> gapFrame(hash_size);
-  dynamic_bitset<> maskFrame(hash_size);
-  dynamic_bitset<> seqFrame(hash_size);
-  if( gaps.size() < hash_size ){
+  if( !pattern.valid() || len < hash_size ){
     //TODO throw an exception?
     return hashes;
   }
 
-  for(unsigned int ii = 0; ii < len; ii++){
-    gapFrame     <<= 1;
-    gapFrame[0]  =   gaps[len - 1 - ii];
-    maskFrame    <<= 1;
-    maskFrame[0] =   mask[len - 1 - ii];
-    seqFrame     <<= 1;
-    seqFrame[0]  =   sequence[len - 1 - ii];
-
-    // Ensure that we've buffered, that we aren't spanning a gap
-    // and that the high order bit is set
-    if( ii >= hash_size && (~gapFrame).none() && maskFrame[hash_size - 1] ){
-      if( maskFrame.count() >= 6 ){
-        Hash h(maskFrame, maskFrame & seqFrame, encoding);
-        cout << ii - hash_size << ":\t" << maskFrame.count() << "\t" << maskFrame << endl;
+  // Windows from the end of the alignment back to the start
+  for(unsigned int ii = len - hash_size + 1; ii-- > 0; ){
+    uint64_t gapFrame  = packedWindow(gaps, ii, hash_size);
+    uint64_t maskFrame = packedWindow(mask, ii, hash_size) & pattern.care();
+
+    // Ensure that we aren't spanning a gap and that the high order bit is set
+    if( gapFrame == full && (maskFrame >> (hash_size - 1)) ){
+      if( __builtin_popcountll(maskFrame) >= (int) pattern.minimum() ){
+        Hash h(maskFrame, maskFrame & packedWindow(consensus, ii, hash_size), hash_size, encoding);
+        //cout << ii << ":\t" << __builtin_popcountll(maskFrame) << endl;
         hashes.push_back(h);
       }
     }
@@ -94,17 +117,59 @@ list<Hash> MultipleSequenceAlgn::makeHashes(vector<int> encoding){
   return hashes;
 }
 
-vector<int> MultipleSequenceAlgn::getMinimalEncoding(){
+// One pass over the alignment, split by columns across threads, the first
+// time the counts are needed.
+const ColumnCounts& MultipleSequenceAlgn::countColumns(int threads){
+  if( _columns.empty() && _sequences.size() ){
+    vector<const string*> rows;
+    vector<Sequence>::iterator s_itr;
+    for( s_itr = _sequences.begin(); s_itr != _sequences.end(); s_itr++ ){
+      rows.push_back(&s_itr->getSeq());
+    }
+    _columns.count(rows, threads);
+  }
+
+  return _columns;
+}
+
+// A bit of a column is concordant when every row has a nucleotide there
+// and all of them agree on the bit. That depends only on which bases occur
+// in the column, so columns are tallied by that set (a 4-bit mask over
+// A, T, C, G) and each encoding is scored from the tally.
+vector<int> MultipleSequenceAlgn::getMinimalEncoding(int threads){
   int baseEncoding[] = {0,1,2,3};
   vector<int> encoding(baseEncoding, baseEncoding + 4);
 
+  const ColumnCounts &counts = countColumns(threads);
+
+  vector<int> columns(16, 0);
+  for( unsigned int ii = 0; ii < counts.columns(); ii++ ){
+    int present = counts.present(ii);
+    if( present >= 0 ){
+      columns[present]++;
+    }
+  }
+
   // How many concordant bits do we have?
   vector< pair< int, vector<int> > > bitCounts;
 
   // Under each possible encoding, how many concordant bits do we have?
   do{
-    dynamic_bitset<> mask = consensusWithEncoding(encoding);
-    int concordance = mask.count();
+    int concordance = 0;
+    for( int present = 1; present < 16; present++ ){
+      if( !columns[present] ){
+        continue;
+      }
+      int ones = 0, zeros = 0;
+      for( int b = 0; b < 4; b++ ){
+        if( present & (1 << b) ){
+          ones  |= encoding[b];
+          zeros |= ~encoding[b] & 3;
+        }
+      }
+      // bits set in every code or clear in every code
+      concordance += columns[present] * __builtin_popcount(~(ones & zeros) & 3);
+    }
     bitCounts.push_back( pair< int, vector<int> >(concordance, encoding));
   } while( next_permutation(encoding.begin(), encoding.end() ) );
 
@@ -116,46 +181,43 @@ vector<int> MultipleSequenceAlgn::getMinimalEncoding(){
 }
 
 // Find the consensus bits given a particular encoding
-dynamic_bitset<> MultipleSequenceAlgn::consensusWithEncoding(vector<int> encoding){
+dynamic_bitset<> MultipleSequenceAlgn::consensusWithEncoding(const vector<int> &encoding){
 
-  dynamic_bitset<> consensus;
-  dynamic_bitset<> mask;
-  if( _sequences.size() ){
-    consensus = _sequences[0].encode(encoding);
-    mask      = _sequences[0].getMask();
+  vector<uint64_t> mask;
+  const ColumnCounts &columns = countColumns();
+  columns.derive(&encoding[0], NULL, NULL, &mask);
 
-    vector<Sequence>::iterator seq_itr;
-    seq_itr = _sequences.begin() + 1;
-
-    // we'll begin by turning mask bits to 0
-    for(; seq_itr != _sequences.end(); seq_itr++ ){
-      dynamic_bitset<> s = seq_itr->encode(encoding);
-      mask &= ~(consensus ^ s); // rm discordant bits from the mask
-      mask &= seq_itr->getMask();
-      consensus &= s;
-    }
-  }
-
-  return mask;
+  return packedBits(mask, 2 * columns.columns());
 }
 
-ReferenceSet MultipleSequenceAlgn::getReferences(){
+ReferenceSet MultipleSequenceAlgn::getReferences(const SeedPattern &pattern){
 
   vector<int> encoding = getMinimalEncoding();
-  list<Hash> hashes = makeHashes(encoding);
+  list<Hash> hashes = makeHashes(encoding, pattern);
   set<Hash> hset = set<Hash>(hashes.begin(), hashes.end());
-  ReferenceSet refs(encoding, hset);
+  ReferenceSet refs(encoding, hset, pattern.window(), pattern.kmer());
   vector<Sequence>::iterator s_itr;
 
   for( s_itr = _sequences.begin(); s_itr != _sequences.end(); s_itr++){
-    refs.insert(Reference(*s_itr, hashes, encoding));
+    refs.insert(*s_itr);
   }
 
   return refs;
 }
 
+// One set of references, each with its own index, for each pattern.
+vector<ReferenceSet> MultipleSequenceAlgn::getReferences(const vector<SeedPattern> &patterns){
+  vector<ReferenceSet> sets;
+  vector<SeedPattern>::const_iterator p_itr;
+  for( p_itr = patterns.begin(); p_itr != patterns.end(); p_itr++ ){
+    sets.push_back(getReferences(*p_itr));
+  }
+  return sets;
+}
+
 Sequence::Sequence(kseq_t* kseq){
   _gapped = -1;
+  _packedWith[0] = -1;
   int len;
   if((len = kseq->name.l)){
     _name = string(kseq->name.s, len);
@@ -181,15 +243,11 @@ Sequence::Sequence(kseq_t* kseq){
     _qual = ""; 
   };
 
-  // construct the mask
-  string::iterator s_itr;
-  for( s_itr = _seq.begin(); s_itr != _seq.end(); s_itr++ ){
-    if( isNucleotide(*s_itr) ){
-      _mask.push_back( true );  _mask.push_back( true );
-    } else {
-      _mask.push_back( false ); _mask.push_back( false );
-    }
-  }
+  // construct the mask, a word at a time, and keep the encoding it came
+  // with
+  int codes[] = {0,1,2,3};
+  pack(codes);
+  _mask = _packed.getMask();
 }
 
 Sequence::Sequence(string seq){
@@ -197,25 +255,18 @@ Sequence::Sequence(string seq){
     _name = "";
     _comment = "";
     _qual = "";
-    _mask = dynamic_bitset<>(seq.size(), true);
+    _mask = dynamic_bitset<>(2*seq.size());
+    _mask.set();
+    _gapped = -1;
+    _packedWith[0] = -1;
 }
 
-bool Sequence::operator<(const Sequence rhs) const {
+bool Sequence::operator<(const Sequence &rhs) const {
   return _name < rhs._name;
 }
 
 bool Sequence::isNucleotide(char n){
-  switch(n){
-    case 'A':
-    case 'a':
-    case 'T':
-    case 't':
-    case 'C':
-    case 'c':
-    case 'G':
-    case 'g': return true;
-    default: return false;
-  }
+  return isNucleotideChar(n);
 }
 
 Sequence Sequence::ungapped(){
@@ -223,57 +274,77 @@ Sequence Sequence::ungapped(){
   Sequence ugs;
   ugs._name = _name;
   ugs._comment = _comment;
-  ugs._mask = dynamic_bitset<>();
   ugs._gapped = -1;
-  for( unsigned int ii = 0 ; ii < _mask.size() ; ++ii ){
-    if( _mask[ii] ){
-      ugs._seq.push_back(_seq[ii]);
-      ugs._qual.push_back(_qual[ii]);
-    }
+
+  // Sequences that weren't read as part of an alignment have every base
+  // unmasked; there's nothing to strip.
+  if( !isGapped() ){
+    ugs._seq = _seq;
+    ugs._qual = _qual;
+  } else if( _seq.size() ){
+    bool qual = _qual.size() > 0;
+    ugs._seq.resize(_seq.size());
+    ugs._qual.resize(qual ? _seq.size() : 0);
+    size_t n = nucleotideStrip(_seq.data(), (qual ? _qual.data() : NULL), _seq.size(), &ugs._seq[0], (qual ? &ugs._qual[0] : NULL));
+    ugs._seq.resize(n);
+    ugs._qual.resize(qual ? n : 0);
   }
 
-  ugs._mask.resize(ugs._seq.size(), true);
+  ugs._mask.resize(2*ugs._seq.size(), true);
 
   return ugs;
 
 }
 
-dynamic_bitset<> Sequence::getMask(){
-  return _mask;
+// The other strand: bases complemented (case kept, gaps and Ns as they
+// are) and everything reversed.
+Sequence Sequence::reverseComplement(){
+
+  Sequence rc;
+  rc._name = _name;
+  rc._comment = _comment;
+  rc._gapped = _gapped;
+  rc._seq.resize(_seq.size());
+  if( _seq.size() ){
+    nucleotideReverseComplement(_seq.data(), _seq.size(), &rc._seq[0]);
+  }
+  rc._qual = string(_qual.rbegin(), _qual.rend());
+
+  // the mask is symmetric in its two bits, so reversing it by base is
+  // reversing it by bit
+  rc._mask.resize(_mask.size(), true);
+  if( isGapped() ){
+    for( size_t ii = 0; ii < _mask.size(); ii++ ){
+      rc._mask[ii] = _mask[_mask.size() - 1 - ii];
+    }
+  }
+
+  return rc;
 }
 
 // Return a sequence given a base encoding scheme
-dynamic_bitset<> Sequence::encode(vector<int> encoding){
-
-  dynamic_bitset<> enc;
+dynamic_bitset<> Sequence::encode(const vector<int> &encoding){
+  return pack(encoding).getBits();
+}
 
-  string::iterator s_itr;
-  for( s_itr = _seq.begin(); s_itr != _seq.end(); s_itr++ ){
-    int bits;
-    switch( *s_itr ){
-      case 'A': 
-      case 'a': bits = encoding[0]; break;
-      case 'T': 
-      case 't': bits = encoding[1]; break;
-      case 'C': 
-      case 'c': bits = encoding[2]; break;
-      case 'G': 
-      case 'g': bits = encoding[3]; break;
-                // if we encounter something else, we need to have
-                // a mask available to store it.
-      default: bits = encoding[0];
-    }
+// The same, packed into words. Anything other than a nucleotide is encoded
+// as an A; the mask has to be consulted for it. The sequence is only packed
+// again when the encoding changes, and then into the words it already has.
+const PackedSequence& Sequence::pack(const vector<int> &encoding){
+  return pack(&encoding[0]);
+}
 
-    enc.push_back( bits % 2 );
-    enc.push_back( (bits / 2) % 2 );
+const PackedSequence& Sequence::pack(const int *codes){
+  if( memcmp(codes, _packedWith, sizeof(_packedWith)) ){
+    _packed.assign(_seq.data(), _seq.size(), codes);
+    memcpy(_packedWith, codes, sizeof(_packedWith));
   }
-
-  return enc;
+  return _packed;
 }
 
 bool Sequence::isGapped(){ 
   if( _gapped < 0 ){
-    _gapped = (~_mask.any() ? 1 : 0);
+    _gapped = (_mask.count() < _mask.size() ? 1 : 0);
   }
 
   return _gapped;
@@ -282,112 +353,826 @@ bool Sequence::isGapped(){
 
 // REFERENCE SET
 
-void ReferenceSet::insert(Reference r){
-    _references.insert(r);
+ReferenceSet::ReferenceSet(){
+    _count = 0;
+    _width = 0;
+}
+
+// Back to an empty set, unmapping any file.
+void ReferenceSet::clear(){
+    _encoding.clear();
+    _references.clear();
+    _hashes.clear();
+    _index = SeedIndex();
+    _placing = SeedIndex();
+    _indexed.clear();
+    _count = 0;
+    _width = 0;
+    _postings.clear();
+    _groupStart.clear();
+    _groups.clear();
+    _setStart.clear();
+    _sets.clear();
+    _setsOfStart.clear();
+    _setsOf.clear();
+    _nameStart.clear();
+    _names.clear();
+    _file.reset();
+}
+
+// With a window, seeds are sampled by (window, kmer) minimizers of the
+// references they're found in.
+ReferenceSet::ReferenceSet(const vector<int> &enc, const set<Hash> &h, unsigned int window, unsigned int kmer){
+    _encoding = enc;
+    _hashes = vector<Hash>(h.begin(), h.end());
+    _postings.resize(_hashes.size());
+    _count = 0;
+    _width = (_hashes.size() ? _hashes[0].size() : 0);
+
+    if( window ){
+        _index.sample(window, kmer);
+        _indexed.assign(_hashes.size(), 0);
+    }
+    SeedIndex &placing = (window ? _placing : _index);
+    for(unsigned int ii = 0; ii < _hashes.size(); ii++){
+        placing.insert(_hashes[ii].getMask(), _hashes[ii].getValue(), _hashes[ii].size(), ii);
+    }
+}
+
+void ReferenceSet::insert(const Reference &r){
+    assert( !_file ); // a loaded set can't be added to
+
+    int ref = _references.size();
+    _references.push_back(r);
+    _count = _references.size();
+
+    vector< pair<Hash, int> >::const_iterator p_itr;
+    for( p_itr = r.getPositions().begin(); p_itr != r.getPositions().end(); p_itr++ ){
+        vector<Hash>::iterator h_itr = lower_bound(_hashes.begin(), _hashes.end(), p_itr->first);
+        if( h_itr != _hashes.end() && !(p_itr->first < *h_itr) ){
+            _postings[h_itr - _hashes.begin()].push_back(pair<int, int>(p_itr->second, ref));
+        }
+    }
+    _groupStart.clear();
     return;
 }
 
-void ReferenceSet::match(Sequence s){
+// Place the set's hashes in s through its own seed index. A sampled set
+// also indexes those placed on one of s's minimizers, by its k-mer there.
+void ReferenceSet::insert(const Sequence &s){
+    assert( !_file );
 
-    dynamic_bitset<> sbits = s.encode(_encoding); 
+    if( !_index.window() ){
+        insert(Reference(s, _index, _hashes, _encoding));
+        return;
+    }
 
-    for(unsigned int ii = 0; ii < _hashes.size(); ii++){
+    Reference r(s, _placing, _hashes, _encoding);
+
+    Sequence ref = s;
+    if( ref.isGapped() ){
+        ref = ref.ungapped();
+    }
+    const PackedSequence &packed = ref.pack(_encoding);
+    vector<int> starts;
+    minimizers(packed, _index.window(), _index.kmer(), starts);
+
+    vector< pair<Hash, int> >::const_iterator p_itr;
+    for( p_itr = r.getPositions().begin(); p_itr != r.getPositions().end(); p_itr++ ){
+        if( !binary_search(starts.begin(), starts.end(), p_itr->second) ){
+            continue;
+        }
+        int id = lower_bound(_hashes.begin(), _hashes.end(), p_itr->first) - _hashes.begin();
+        const Hash &h = _hashes[id];
+        _index.insert(h.getMask(), h.getValue(), h.size(), id, packed.window(p_itr->second, 2 * _index.kmer()));
+        _indexed[id]++;
     }
 
+    insert(r);
 }
 
-Reference::Reference(Sequence seq, list<Hash> hashes, vector<int> enc){
-  _ref = seq;
+// Most seeds sit at the same place in most references, so the postings are
+// grouped by place and each group's references shared as one set.
+void ReferenceSet::group(){
+
+    if( _groupStart.size() ){
+        return;
+    }
+
+    map<vector<int>, int> ids;
+    vector<int> groupStart(1, 0), setStart(1, 0), sets, nameStart;
+    vector<hash_group> groups;
+    vector< vector<int> > setsOf(_references.size());
+    vector<char> names;
+
+    for( unsigned int ii = 0; ii < _postings.size(); ii++ ){
+        // a hash a sampled index doesn't hold is never seen
+        if( _indexed.size() && !_indexed[ii] ){
+            groupStart.push_back(groups.size());
+            continue;
+        }
+        vector< pair<int, int> > postings = _postings[ii];
+        sort(postings.begin(), postings.end());
+
+        for( unsigned int jj = 0; jj < postings.size(); ){
+            vector<int> refs;
+            unsigned int kk = jj;
+            for( ; kk < postings.size() && postings[kk].first == postings[jj].first; kk++ ){
+                refs.push_back(postings[kk].second);
+            }
+
+            map<vector<int>, int>::iterator id_itr = ids.find(refs);
+            if( id_itr == ids.end() ){
+                int set = setStart.size() - 1;
+                id_itr = ids.insert(pair<vector<int>, int>(refs, set)).first;
+                for( unsigned int rr = 0; rr < refs.size(); rr++ ){
+                    setsOf[refs[rr]].push_back(set);
+                }
+                sets.insert(sets.end(), refs.begin(), refs.end());
+                setStart.push_back(sets.size());
+            }
+            hash_group g = {postings[jj].first, id_itr->second};
+            groups.push_back(g);
+            jj = kk;
+        }
+        groupStart.push_back(groups.size());
+    }
+
+    vector<int> setsOfStart(1, 0), setsOfFlat;
+    for( unsigned int ii = 0; ii < setsOf.size(); ii++ ){
+        setsOfFlat.insert(setsOfFlat.end(), setsOf[ii].begin(), setsOf[ii].end());
+        setsOfStart.push_back(setsOfFlat.size());
+    }
+
+    for( unsigned int ii = 0; ii < _references.size(); ii++ ){
+        const string &name = _references[ii].getName();
+        nameStart.push_back(names.size());
+        names.insert(names.end(), name.begin(), name.end());
+        names.push_back('\0');
+    }
+
+    _groupStart.swap(groupStart);
+    _groups.swap(groups);
+    _setStart.swap(setStart);
+    _sets.swap(sets);
+    _setsOfStart.swap(setsOfStart);
+    _setsOf.swap(setsOfFlat);
+    _nameStart.swap(nameStart);
+    _names.swap(names);
+}
+
+const char* ReferenceSet::getName(int ii){
+    group();
+    if( ii < 0 || (size_t) ii >= _nameStart.size() || _nameStart[ii] < 0 || (size_t) _nameStart[ii] >= _names.size() ){
+        return "";
+    }
+    return &_names[_nameStart[ii]];
+}
 
-  list<Hash>::iterator h_itr;
+// Write what matching needs (the seed tables, the grouped postings and the
+// reference names) to fn, to be mapped by load.
+bool ReferenceSet::save(const char *fn){
+    group();
+
+    vector<seed_table_info> tables;
+    vector<seed_slot> slots;
+    vector<uint64_t> filters;
+    _index.flatten(tables, slots, filters);
+
+    reference_file_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, REFERENCE_FILE_MAGIC, sizeof(h.magic));
+    for( unsigned int ii = 0; ii < 4 && ii < _encoding.size(); ii++ ){
+        h.encoding[ii] = _encoding[ii];
+    }
+    h.width = _width;
+    h.hashes = _groupStart.size() - 1;
+    h.references = _count;
+    h.window = _index.window();
+    h.kmer = _index.kmer();
+
+    MappedWriter w;
+    bool ok = w.open(fn, sizeof(h)) &&
+        w.write(tables.empty() ? NULL : &tables[0], tables.size(), h.tables) &&
+        w.write(slots.empty() ? NULL : &slots[0], slots.size(), h.slots) &&
+        w.write(filters.empty() ? NULL : &filters[0], filters.size(), h.filters) &&
+        w.write(_groupStart, h.groupStart) && w.write(_groups, h.groups) &&
+        w.write(_setStart, h.setStart) && w.write(_sets, h.sets) &&
+        w.write(_setsOfStart, h.setsOfStart) && w.write(_setsOf, h.setsOf) &&
+        w.write(_nameStart, h.nameStart) && w.write(_names, h.names) &&
+        w.finish(&h, sizeof(h));
+    if( !ok ){
+        fprintf(stderr, "Could not write %s\n", fn);
+    }
+    return ok;
+}
+
+// Map a file written by save in place of whatever was here, which is
+// dropped first; a set that fails to load is left empty. Everything is
+// read where it lies, shared with any other process mapping the file, and
+// only the header and the sections' sizes are checked, so loading takes
+// the same time whatever the size of the index. The entries aren't: every
+// lookup through them is cut to what's there (see runOf), so a damaged
+// file gives wrong answers rather than reads out of bounds.
+bool ReferenceSet::load(const char *fn){
+
+    clear();
+    boost::shared_ptr<MappedFile> file(new MappedFile());
+    if( !file->open(fn) ){
+        return false;
+    }
+
+    const reference_file_header *h = (const reference_file_header*) file->data();
+    if( file->size() < sizeof(*h) || memcmp(h->magic, REFERENCE_FILE_MAGIC, sizeof(h->magic)) ){
+        fprintf(stderr, "%s is not a seed index\n", fn);
+        return false;
+    }
 
-  for( h_itr = hashes.begin(); h_itr != hashes.end(); h_itr++ ){
-    set<int> m = h_itr->matches(_ref);
-    if(m.size() == 1){
-      _positions.insert(pair<Hash, int>(*h_itr, *(m.begin())));
+    FlatArray<seed_table_info> tables;
+    FlatArray<seed_slot> slots;
+    FlatArray<uint64_t> filters;
+    _encoding = vector<int>(h->encoding, h->encoding + 4);
+    _width = h->width;
+    _count = h->references;
+    bool ok = file->section(h->tables, tables) && file->section(h->slots, slots) &&
+        file->section(h->filters, filters) &&
+        file->section(h->groupStart, _groupStart) && file->section(h->groups, _groups) &&
+        file->section(h->setStart, _setStart) && file->section(h->sets, _sets) &&
+        file->section(h->setsOfStart, _setsOfStart) && file->section(h->setsOf, _setsOf) &&
+        file->section(h->nameStart, _nameStart) && file->section(h->names, _names);
+    ok = ok && h->hashes < INT_MAX && h->references < INT_MAX &&
+        _groupStart.size() == h->hashes + 1 && !_setStart.empty() &&
+        _setsOfStart.size() == h->references + 1 && _nameStart.size() == h->references &&
+        (_names.empty() || _names[_names.size() - 1] == '\0') &&
+        (h->window == 0 || (h->kmer >= 1 && h->kmer <= 32 && tables.size() == 1)) &&
+        _index.map(h->width, tables.data(), tables.size(), slots.data(), slots.size(), filters.data(), filters.size(), h->hashes);
+    if( !ok ){
+        fprintf(stderr, "%s is damaged\n", fn);
+        clear();
+        return false;
+    }
+
+    if( h->window ){
+        _index.sample(h->window, h->kmer);
+    }
+    _file = file;
+    return true;
+}
+
+// Append the read's seed hits. Reads (which aren't gapped) are packed into
+// words they keep, so once a read and hits have room nothing is allocated.
+void ReferenceSet::seed(Sequence &s, vector<seed_hit> &hits){
+    if( s.isGapped() ){
+        _index.match(s.ungapped().pack(_encoding), hits);
     } else {
-        // printf("Hash matched %d times\n", m.size());
+        _index.match(s.pack(_encoding), hits);
     }
+}
+
+// Run ii of the runs over entries start delimits, as [begin, end), cut to
+// what's there; empty if there's no run ii.
+static inline void runOf(const FlatArray<int> &start, int ii, size_t entries, int &begin, int &end){
+    if( ii < 0 || (size_t) ii + 1 >= start.size() ){
+        begin = end = 0;
+        return;
+    }
+    begin = max(start[ii], 0);
+    end = min(start[ii + 1], (int) entries);
+}
+
+static bool byOffsetReference(const reference_hit &lhs, const reference_hit &rhs){
+    return lhs.offset < rhs.offset || (lhs.offset == rhs.offset && lhs.reference < rhs.reference);
+}
+
+static bool moreHitsThenDiagonal(const reference_hit &lhs, const reference_hit &rhs){
+    return lhs.hits > rhs.hits || (lhs.hits == rhs.hits && byOffsetReference(lhs, rhs));
+}
+
+// The references the read's seeds fall in, one entry per reference and
+// offset, best supported first. Offsets are in bases; a seed hit an odd
+// number of bits away from where it sits in the reference is out of frame
+// and can't come from an ungapped alignment, so it's ignored.
+vector<reference_hit> ReferenceSet::match(Sequence &s){
+    vector<reference_hit> res;
+    match(s, res);
+    return res;
+}
+
+// The same into res, counted over one offset at a time in buffers kept
+// between reads, so that once they've grown nothing is allocated.
+void ReferenceSet::match(Sequence &s, vector<reference_hit> &res){
+
+    res.clear();
+    _hits.clear();
+    seed(s, _hits);
+    group();
+
+    // count hits by (offset, reference set) first ...
+    _offsetSets.clear();
+    vector<seed_hit>::iterator h_itr;
+    for( h_itr = _hits.begin(); h_itr != _hits.end(); h_itr++ ){
+        int begin, end;
+        runOf(_groupStart, h_itr->id, _groups.size(), begin, end);
+        for( int ii = begin; ii < end; ii++ ){
+            int offset = h_itr->position - _groups[ii].place;
+            if( offset % 2 == 0 ){
+                _offsetSets.push_back(pair<int, int>(offset / 2, _groups[ii].set));
+            }
+        }
+    }
+    sort(_offsetSets.begin(), _offsetSets.end());
+
+    // ... then hand each count out to the set's references, collecting an
+    // offset's counts per reference before moving on to the next one
+    _referenceHits.resize(_count, 0);
+    for( unsigned int ii = 0; ii < _offsetSets.size(); ){
+        int offset = _offsetSets[ii].first;
+        _touched.clear();
+        while( ii < _offsetSets.size() && _offsetSets[ii].first == offset ){
+            unsigned int jj = ii;
+            while( jj < _offsetSets.size() && _offsetSets[jj] == _offsetSets[ii] ){
+                jj++;
+            }
+            int begin, end;
+            runOf(_setStart, _offsetSets[ii].second, _sets.size(), begin, end);
+            for( int kk = begin; kk < end; kk++ ){
+                int ref = _sets[kk];
+                if( ref < 0 || ref >= _count ){
+                    continue;
+                }
+                if( _referenceHits[ref] == 0 ){
+                    _touched.push_back(ref);
+                }
+                _referenceHits[ref] += jj - ii;
+            }
+            ii = jj;
+        }
+
+        sort(_touched.begin(), _touched.end());
+        for( unsigned int t = 0; t < _touched.size(); t++ ){
+            reference_hit r = {_touched[t], offset, _referenceHits[_touched[t]]};
+            res.push_back(r);
+            _referenceHits[_touched[t]] = 0;
+        }
+    }
+
+    // stable_sort would want a buffer of its own; equals are already in
+    // (offset, reference) order and are kept that way by the comparison
+    sort(res.begin(), res.end(), moreHitsThenDiagonal);
+}
+
+// What the seeds cost and find. A hash survives a read's errors when none
+// of the bases it reads is wrong, so a read of a whole reference is expected
+// to hit each hash placed in it with probability (1 - error)^bases. An
+// unrelated read is probed at every bit offset, and matches a hash at each
+// with probability 2^-bits, bits being those under its mask. Only a set
+// built from an alignment has the hashes to tell; a loaded one gives sizes.
+//
+// A sampled set only finds a hash in the references it was indexed from,
+// and probes a read at its minimizers, about 2 / (w + 1) of its k-mers,
+// against seeds whose k-mer and mask both have to match.
+seed_design ReferenceSet::design(double error, int readLength){
+    group();
+
+    seed_design d = {_width, (int) _hashes.size(), _index.bytes(), 0.0, 0.0, 0.0};
+    d.bytes += _groups.size() * sizeof(hash_group) + _names.size() +
+        (_groupStart.size() + _setStart.size() + _sets.size() + _setsOfStart.size() + _setsOf.size() + _nameStart.size()) * sizeof(int);
+
+    unsigned int w = _index.window(), k = _index.kmer();
+    if( w ){
+        d.probes = max(0, readLength - (int) k + 1) * 2.0 / (w + 1);
+        uint64_t kmer = (k < 32 ? (1ULL << (2 * k)) - 1 : ~0ULL);
+        const vector<seed_slot> &seeds = _index.seeds();
+        for( unsigned int ii = 0; ii < seeds.size(); ii++ ){
+            d.random += d.probes * ldexp(1.0, -__builtin_popcountll(seeds[ii].mask | kmer));
+        }
+    } else {
+        d.probes = 2.0 * readLength * _index.tables();
+    }
+
+    int windows = max(0, 2 * readLength - (int) _width + 1);
+    for( unsigned int ii = 0; ii < _hashes.size(); ii++ ){
+        uint64_t mask = _hashes[ii].getMask();
+        int bases = __builtin_popcountll((mask | (mask >> 1)) & 0x5555555555555555ULL);
+        if( w ){
+            bases = max(bases, (int) k); // the k-mer has to survive too
+            d.hits += _indexed[ii] * pow(1.0 - error, bases);
+        } else {
+            d.hits   += _postings[ii].size() * pow(1.0 - error, bases);
+            d.random += windows * ldexp(1.0, -__builtin_popcountll(mask));
+        }
+    }
+    if( _count ){
+        d.hits /= _count;
+    }
+    return d;
+}
+
+// Chaining allows a chain to step between diagonals (an indel) of up to
+// CHAIN_MAX_SHIFT bases, at CHAIN_SHIFT_PENALTY hits a base.
+#define CHAIN_MAX_SHIFT 16
+#define CHAIN_SHIFT_PENALTY 2
+
+// The hits along one diagonal, read bases [start, end).
+typedef struct {
+  int offset;
+  int start;
+  int end;
+  int hits;
+  int diagonal; // index among the read's distinct offsets
+} diagonal_run;
+
+static bool byDiagonal(const hash_info &lhs, const hash_info &rhs){
+  if( lhs.references != rhs.references ){
+    return lhs.references < rhs.references;
+  }
+  if( lhs.offset != rhs.offset ){
+    return lhs.offset < rhs.offset;
+  }
+  return lhs.observed_position < rhs.observed_position;
+}
+
+static bool byStart(const diagonal_run &lhs, const diagonal_run &rhs){
+  return lhs.start < rhs.start;
+}
+
+static bool moreScore(const reference_chain &lhs, const reference_chain &rhs){
+  return lhs.score > rhs.score;
+}
+
+// Chain the read's seed hits into the best colinear run of diagonals in
+// each reference, best chains first.
+vector<reference_chain> ReferenceSet::chain(Sequence &s){
+
+    vector<reference_chain> res;
+    vector<seed_hit> hits;
+
+    seed(s, hits);
+    group();
+
+    if( hits.empty() ){
+        return res;
+    }
+    int width = _width / 2;
+
+    // Place every hit against each set of references it's expected in ...
+    vector<hash_info> placed;
+    vector<seed_hit>::iterator h_itr;
+    for( h_itr = hits.begin(); h_itr != hits.end(); h_itr++ ){
+        int begin, end;
+        runOf(_groupStart, h_itr->id, _groups.size(), begin, end);
+        for( int ii = begin; ii < end; ii++ ){
+            const hash_group &g = _groups[ii];
+            int offset = h_itr->position - g.place;
+            if( offset % 2 == 0 && g.set >= 0 && (size_t) g.set + 1 < _setStart.size() ){
+                hash_info h = {h_itr->id, g.set, g.place, h_itr->position, offset / 2};
+                placed.push_back(h);
+            }
+        }
+    }
+
+    // ... and bucket them by diagonal, a run per set and offset.
+    sort(placed.begin(), placed.end(), byDiagonal);
+
+    vector<int> offsets;
+    for( unsigned int ii = 0; ii < placed.size(); ii++ ){
+        offsets.push_back(placed[ii].offset);
+    }
+    sort(offsets.begin(), offsets.end());
+    offsets.erase(unique(offsets.begin(), offsets.end()), offsets.end());
+
+    vector<diagonal_run> runs;
+    vector<int> setRuns(_setStart.size(), 0); // the runs of set i are [setRuns[i], setRuns[i+1])
+    for( unsigned int ii = 0; ii < placed.size(); ){
+        diagonal_run r = {placed[ii].offset, placed[ii].observed_position / 2, 0, 0, 0};
+        r.diagonal = lower_bound(offsets.begin(), offsets.end(), r.offset) - offsets.begin();
+        unsigned int jj = ii;
+        for( ; jj < placed.size() && placed[jj].references == placed[ii].references && placed[jj].offset == r.offset; jj++ ){
+            r.hits++;
+        }
+        r.end = placed[jj - 1].observed_position / 2 + width;
+        runs.push_back(r);
+        setRuns[placed[ii].references + 1] = runs.size();
+        ii = jj;
+    }
+    for( unsigned int ii = 1; ii < setRuns.size(); ii++ ){
+        setRuns[ii] = max(setRuns[ii], setRuns[ii - 1]);
+    }
+
+    // Then for each reference, gather its runs, one per diagonal, and chain
+    // them in read order.
+    diagonal_run none = {0, 0, 0, 0, 0};
+    vector<diagonal_run> diagonals(offsets.size(), none);
+    vector<diagonal_run> mine;
+    vector<int> score;
+    vector<int> prev;
+    for( int ref = 0; ref < _count; ref++ ){
+
+        mine.clear();
+        int begin, end;
+        runOf(_setsOfStart, ref, _setsOf.size(), begin, end);
+        for( int ii = begin; ii < end; ii++ ){
+            int set = _setsOf[ii];
+            if( set < 0 || (size_t) set + 1 >= setRuns.size() ){
+                continue;
+            }
+            for( int jj = setRuns[set]; jj < setRuns[set + 1]; jj++ ){
+                diagonal_run &r = runs[jj];
+                diagonal_run &d = diagonals[r.diagonal];
+                if( d.hits ){
+                    d.start = min(d.start, r.start);
+                    d.end   = max(d.end, r.end);
+                    d.hits += r.hits;
+                } else {
+                    d = r;
+                    mine.push_back(r);
+                }
+            }
+        }
+        if( mine.empty() ){
+            continue;
+        }
+
+        for( unsigned int ii = 0; ii < mine.size(); ii++ ){
+            mine[ii] = diagonals[mine[ii].diagonal];
+            diagonals[mine[ii].diagonal].hits = 0;
+        }
+        sort(mine.begin(), mine.end(), byStart);
+
+        score.assign(mine.size(), 0);
+        prev.assign(mine.size(), -1);
+        int best = 0;
+        for( unsigned int ii = 0; ii < mine.size(); ii++ ){
+            score[ii] = mine[ii].hits;
+            for( unsigned int jj = 0; jj < ii; jj++ ){
+                int shift = abs(mine[ii].offset - mine[jj].offset);
+                // colinear in both the read and the reference
+                if( shift > CHAIN_MAX_SHIFT || mine[jj].start >= mine[ii].start ||
+                    mine[jj].start - mine[jj].offset >= mine[ii].start - mine[ii].offset ){
+                    continue;
+                }
+                int chained = score[jj] + mine[ii].hits - CHAIN_SHIFT_PENALTY * shift;
+                if( chained > score[ii] ){
+                    score[ii] = chained;
+                    prev[ii] = jj;
+                }
+            }
+            if( score[ii] > score[best] ){
+                best = ii;
+            }
+        }
+
+        reference_chain c = {ref, mine[best].offset, mine[best].offset, score[best]};
+        for( int ii = prev[best]; ii >= 0; ii = prev[ii] ){
+            c.low  = min(c.low, mine[ii].offset);
+            c.high = max(c.high, mine[ii].offset);
+        }
+        res.push_back(c);
+    }
+
+    stable_sort(res.begin(), res.end(), moreScore);
+    return res;
+}
+
+static bool equalHash(const Hash &lhs, const Hash &rhs){
+  return !(lhs < rhs) && !(rhs < lhs);
+}
+
+Reference::Reference(const Sequence &seq, const list<Hash> &hashes, const vector<int> &enc){
+  _ref = seq;
+
+  vector<Hash> sorted(hashes.begin(), hashes.end());
+  sort(sorted.begin(), sorted.end());
+  sorted.erase(unique(sorted.begin(), sorted.end(), equalHash), sorted.end());
+
+  SeedIndex index;
+  for( unsigned int ii = 0; ii < sorted.size(); ii++ ){
+    index.insert(sorted[ii].getMask(), sorted[ii].getValue(), sorted[ii].size(), ii);
   }
+  place(index, sorted, enc);
+}
+
+// hashes are in order, and index holds them by their place in it.
+Reference::Reference(const Sequence &seq, SeedIndex &index, const vector<Hash> &hashes, const vector<int> &enc){
+  _ref = seq;
+  place(index, hashes, enc);
+}
+
+static bool byHashThenPosition(const seed_hit &lhs, const seed_hit &rhs){
+  return lhs.id < rhs.id || (lhs.id == rhs.id && lhs.position < rhs.position);
 }
 
-bool Reference::operator<(const Reference rhs) const {
+// Find every hash in one pass over the reference and keep those found
+// exactly once.
+void Reference::place(SeedIndex &index, const vector<Hash> &hashes, const vector<int> &enc){
+
+  vector<seed_hit> hits;
+  if( _ref.isGapped() ){
+    index.match(_ref.ungapped().pack(enc), hits);
+  } else {
+    index.match(_ref.pack(enc), hits);
+  }
+  sort(hits.begin(), hits.end(), byHashThenPosition);
+
+  for( unsigned int ii = 0; ii < hits.size(); ){
+    unsigned int jj = ii + 1;
+    while( jj < hits.size() && hits[jj].id == hits[ii].id ){
+      jj++;
+    }
+    if( jj == ii + 1 ){
+      _positions.push_back(pair<Hash, int>(hashes[hits[ii].id], hits[ii].position));
+    }
+    ii = jj;
+  }
+}
+
+bool Reference::operator<(const Reference &rhs) const {
   return _ref < rhs._ref;
 }
 
 
-Hash::Hash(dynamic_bitset<> mask, dynamic_bitset<> val, vector<int> encoding){
-  _value = val;
+Hash::Hash(uint64_t mask, uint64_t val, unsigned int size, const vector<int> &encoding){
+  _value = val & mask;
   _mask = mask;
-  _size = mask.size();
-  _encoding = encoding;
-  printf("got hash %d\n", encoding.size());
+  _size = size;
+  assert( encoding.size() == 4 );
+  copy(encoding.begin(), encoding.end(), _encoding);
+  //printf("got hash %d\n", encoding.size());
 }
 
-bool Hash::operator<(const Hash rhs) const {
-  return _value < rhs._value;
+// Order by value, then mask; hashes with the same masked value but
+// different masks are distinct.
+bool Hash::operator<(const Hash &rhs) const {
+  return _value < rhs._value || (_value == rhs._value && _mask < rhs._mask);
 }
 
-bool Hash::operator>(const Hash rhs) const {
-  return _value > rhs._value;
+bool Hash::operator>(const Hash &rhs) const {
+  return rhs < *this;
 }
 
-set<int> Hash::matches(dynamic_bitset<> encoded){
+set<int> Hash::matches(const PackedSequence &encoded) const {
   //TODO It might make more sense to iterate over the sequence once
   // trying all the hashes as we go. First get it working, then get
   // it right.
 
   set<int> res;
-  dynamic_bitset<> buffer;
-
-  //fill the buffer
-  for(unsigned int ii = 0; ii < _mask.size(); ii++){
-    buffer.push_back(encoded[ii]);
-  }
 
   // march over the sequence and find hits
-  unsigned int index = 0;
-  do{
-    if( match(buffer) ){
+  for(unsigned int index = 0; index + _size <= encoded.bits(); index++){
+    if( match(encoded.window(index, _size)) ){
       res.insert(index);
     }
-  }while( index++ < encoded.size() - _mask.size() );
+  }
 
   // and return the set
   return res;
 }
 
 
-set<int> Hash::matches(Sequence seq){
+set<int> Hash::matches(Sequence &seq) const {
 
-  dynamic_bitset<> encoded;
   if( seq.isGapped() ){
-    encoded = seq.ungapped().encode(_encoding);   
+    return matches(seq.ungapped().pack(_encoding));
   } else {
-    encoded = seq.encode(_encoding);
+    return matches(seq.pack(_encoding));
   }
 
-  return matches(encoded);
-
 }
 
-bool Hash::match(dynamic_bitset<> t){
+bool Hash::match(uint64_t t) const {
   //cout << (_value) << endl << (t & _mask) << endl;
   return (_value == (t & _mask));
 }
 
 
+#ifndef NO_MAIN
+static bool readAlignment(const char *in, MultipleSequenceAlgn &m){
+  gzFile fp = gzopen(in, "r");
+  if( !fp ){
+    fprintf(stderr, "Could not open %s\n", in);
+    return false;
+  }
+  kseq_t *seq = kseq_init(fp);
+  while( kseq_read(seq) >= 0 ){
+    m.insert(seq);
+  }
+  kseq_destroy(seq);
+  gzclose(fp);
+  return true;
+}
+
+// hashalign index <alignment> <out.idx> [pattern]
+//   Build the seed index of an alignment once and write it out.
+static int indexCommand(const char *in, const char *out, const char *spec){
+
+  SeedPattern pattern(spec);
+  if( !pattern.valid() ){
+    fprintf(stderr, "Bad seed pattern %s\n", spec);
+    return 1;
+  }
+
+  MultipleSequenceAlgn m;
+  if( !readAlignment(in, m) ){
+    return 1;
+  }
+
+  ReferenceSet refset = m.getReferences(pattern);
+  if( !refset.save(out) ){
+    return 1;
+  }
+  fprintf(stderr, "Indexed %d references\n", refset.size());
+  return 0;
+}
+
+// hashalign match <index> <reads>
+//   Map the index and report the best candidate references of each read,
+//   then on stderr how many seed probes the filters turned away.
+static int matchCommand(const char *index, const char *in){
+
+  ReferenceSet refset;
+  if( !refset.load(index) ){
+    return 1;
+  }
+
+  gzFile fp = gzopen(in, "r");
+  if( !fp ){
+    fprintf(stderr, "Could not open %s\n", in);
+    return 1;
+  }
+  kseq_t *seq = kseq_init(fp);
+  while( kseq_read(seq) >= 0 ){
+    Sequence read(seq);
+    vector<reference_hit> candidates = refset.match(read);
+    printf("%s", read.getName().c_str());
+    for( unsigned int ii = 0; ii < candidates.size() && ii < 5; ii++ ){
+      printf("\t%s:%d:%d", refset.getName(candidates[ii].reference), candidates[ii].offset, candidates[ii].hits);
+    }
+    printf("\n");
+  }
+  kseq_destroy(seq);
+  gzclose(fp);
+
+  const seed_probe_counts &probes = refset.probeCounts();
+  fprintf(stderr, "{\"probes\": %ld, \"filtered\": %ld, \"found\": %ld, \"false_positive_rate\": %.5f}\n",
+          probes.probes, probes.probes - probes.passed, probes.found,
+          (probes.probes > probes.found ? (double) (probes.passed - probes.found) / (probes.probes - probes.found) : 0.0));
+  return 0;
+}
+
+// hashalign design <alignment> <error rate> <read length> <pattern>...
+//   Index the alignment under each seed pattern and report, one JSON line
+//   each, what the index costs and the hits a read can expect.
+static int designCommand(const char *in, double error, int readLength, int count, char **specs){
+
+  vector<SeedPattern> patterns;
+  for( int ii = 0; ii < count; ii++ ){
+    patterns.push_back(SeedPattern(specs[ii]));
+    if( !patterns.back().valid() ){
+      fprintf(stderr, "Bad seed pattern %s\n", specs[ii]);
+      return 1;
+    }
+  }
+
+  MultipleSequenceAlgn m;
+  if( !readAlignment(in, m) ){
+    return 1;
+  }
+
+  vector<ReferenceSet> sets = m.getReferences(patterns);
+  for( unsigned int ii = 0; ii < sets.size(); ii++ ){
+    seed_design d = sets[ii].design(error, readLength);
+    printf("{\"pattern\": \"%s\", \"minimum\": %u, \"window\": %u, \"kmer\": %u, \"width\": %u, \"hashes\": %d, \"index_bytes\": %lu, "
+           "\"probes_per_read\": %.1f, \"hits_per_read\": %.2f, \"random_hits_per_read\": %.4f}\n",
+           patterns[ii].getPattern().c_str(), patterns[ii].minimum(), patterns[ii].window(), patterns[ii].kmer(), d.width, d.hashes,
+           (unsigned long) d.bytes, d.probes, d.hits, d.random);
+  }
+  return 0;
+}
+
 int main(int argc, char *argv[])
 {
 
+  if( (argc == 4 || argc == 5) && !strcmp(argv[1], "index") ){
+    return indexCommand(argv[2], argv[3], (argc == 5 ? argv[4] : DEFAULT_SEED_PATTERN));
+  }
+  if( argc >= 6 && !strcmp(argv[1], "design") ){
+    return designCommand(argv[2], atof(argv[3]), atoi(argv[4]), argc - 5, argv + 5);
+  }
+  if( argc == 4 && !strcmp(argv[1], "match") ){
+    return matchCommand(argv[2], argv[3]);
+  }
+
   MultipleSequenceAlgn m;
 
   vector<kseq_t*> sequences;
   gzFile fp;
   kseq_t *seq;
   int l;
-  if (argc == 1) {
+  if (argc != 2) {
     fprintf(stderr, "Usage: %s <in.seq>\n", argv[0]);
+    fprintf(stderr, "       %s index <in.seq> <out.idx> [pattern[:min][/w,k]]\n", argv[0]);
+    fprintf(stderr, "       %s design <in.seq> <error rate> <read length> <pattern[:min][/w,k]>...\n", argv[0]);
+    fprintf(stderr, "       %s match <in.idx> <reads.seq>\n", argv[0]);
     return 1;
   }
   fp = gzopen(argv[1], "r");
@@ -440,8 +1225,13 @@ int main(int argc, char *argv[])
 
   Sequence testSeq("CAGGTCACCTTGAAGGAGTCTGGTCCTGTGCTGGTGAAACCCACAGAGACCCTCACGCTGACCTGCACCGTCTCTGGGTTCTCACTCAGCAATGCTAGAATGGGTGTGAGCTGGATCCGTCAGCCCCCAGGGAAGGCCCTGGAGTGGCTTGCACACATTTTTTCGAATGACGAAAAATCCTACAGCACATCTCTGAAGAGCAGGCTCACCATCTCCAAGGACACCTCCAAAAGCCAGGTGGTCCTTACCATGACCAACATGGACCCTGTGGACACAGCCACATATTACTG");
 
+  vector<reference_hit> candidates = refset.match(testSeq);
+  for( unsigned int ii = 0; ii < candidates.size() && ii < 5; ii++ ){
+    printf("%s\toffset %d\t%d hits\n", refset.getName(candidates[ii].reference), candidates[ii].offset, candidates[ii].hits);
+  }
+
   kseq_destroy(seq);
   gzclose(fp);
   return 0;
 }
-
+#endif
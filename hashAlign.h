@@ -1,14 +1,23 @@
+#ifndef _HASHALIGN_H_
+#define _HASHALIGN_H_
+
 #include <limits.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <zlib.h>
+#include "columns.h"
 #include "kseq.h"
+#include "mapped.h"
+#include "packed.h"
+#include "seedindex.h"
 
 #include <algorithm>
 #include <list>
 #include <map>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <boost/dynamic_bitset.hpp>
@@ -20,45 +29,60 @@ class Hash;
 class Reference;
 class ReferenceSet;
 
+// The seeds taken unless asked otherwise: 12 contiguous bases with at least
+// 6 informative bits, indexed and probed only at (10,8) minimizers. Probing
+// every offset (DEFAULT_SEED_SHAPE alone) counts more hits but costs
+// several times as much a read.
+#define DEFAULT_SEED_SHAPE "111111111111:6"
+#define DEFAULT_SEED_PATTERN DEFAULT_SEED_SHAPE "/10,8"
+
 class MultipleSequenceAlgn { 
   public:
     MultipleSequenceAlgn(){};
     ~MultipleSequenceAlgn(){};
     int insert(kseq_t* s);
-    bool remove(std::string);
-    std::vector<int> getMinimalEncoding();
+    bool remove(const std::string&);
+    std::vector<int> getMinimalEncoding(int threads = 1);
     boost::dynamic_bitset<> getGaps();
-    std::list<Hash> makeHashes(std::vector<int>);
-    boost::dynamic_bitset<> consensusWithEncoding(std::vector<int> encoding);
-    ReferenceSet getReferences();
+    std::list<Hash> makeHashes(const std::vector<int>&, const SeedPattern& = SeedPattern(DEFAULT_SEED_PATTERN));
+    boost::dynamic_bitset<> consensusWithEncoding(const std::vector<int> &encoding);
+    ReferenceSet getReferences(const SeedPattern& = SeedPattern(DEFAULT_SEED_PATTERN));
+    std::vector<ReferenceSet> getReferences(const std::vector<SeedPattern>&);
   private:
 
     //Member functions
+    const ColumnCounts& countColumns(int threads = 1);
     std::vector<Sequence> _sequences;
 
     //Member variables
+    // row of every name
+    std::unordered_multimap<std::string, int> _names;
     boost::dynamic_bitset<> _gaps;
+    // Built on demand, then kept up to date by insert and remove.
+    ColumnCounts _columns;
     int _length;
 };
 
 class Hash {
   public:
     Hash(){ _size = 0;};
-    Hash(boost::dynamic_bitset<>, boost::dynamic_bitset<>, std::vector<int>);
+    Hash(uint64_t, uint64_t, unsigned int, const std::vector<int>&);
     ~Hash(){};
-    std::set<int> matches(Sequence);
-    std::set<int> matches(boost::dynamic_bitset<>);
-    bool match(boost::dynamic_bitset<>);
-    bool operator<(const Hash) const;
-    bool operator>(const Hash) const;
-    unsigned int size(){ return _size; }
-    std::vector<int> getEncoding() const { return _encoding; }
-    std::vector<int> getEncoding() { return _encoding; }
-    boost::dynamic_bitset<> getMask(){ return _mask; }
+    std::set<int> matches(Sequence&) const;
+    std::set<int> matches(const PackedSequence&) const;
+    bool match(uint64_t) const;
+    bool operator<(const Hash&) const;
+    bool operator>(const Hash&) const;
+    unsigned int size() const { return _size; }
+    std::vector<int> getEncoding() const { return std::vector<int>(_encoding, _encoding + 4); }
+    const int* getCodes() const { return _encoding; }
+    uint64_t getMask() const { return _mask; }
+    uint64_t getValue() const { return _value; }
   private:
-    std::vector<int> _encoding;
-    boost::dynamic_bitset<> _mask;
-    boost::dynamic_bitset<> _value;
+    // held inline so that copying a hash doesn't allocate
+    int _encoding[4];
+    uint64_t _mask;
+    uint64_t _value;
     int _size;
 };
 
@@ -66,14 +90,18 @@ class Sequence {
   public:
     Sequence(kseq_t*);
     Sequence(std::string);
-    Sequence(){};
+    Sequence() : _gapped(-1) { _packedWith[0] = -1; }
     ~Sequence(){};
     Sequence ungapped();
-    boost::dynamic_bitset<> encode(std::vector<int> encoding);
-    boost::dynamic_bitset<> getMask();
-    std::string getName(){ return _name; }
+    Sequence reverseComplement();
+    boost::dynamic_bitset<> encode(const std::vector<int> &encoding);
+    const PackedSequence& pack(const std::vector<int> &encoding);
+    const PackedSequence& pack(const int *codes);
+    const boost::dynamic_bitset<>& getMask() const { return _mask; }
+    const std::string& getName() const { return _name; }
+    const std::string& getSeq() const { return _seq; }
     bool isGapped();
-    bool operator<(const Sequence) const;
+    bool operator<(const Sequence&) const;
   private:
     bool isNucleotide(char);
     std::string _name;
@@ -82,38 +110,157 @@ class Sequence {
     std::string _qual;
     boost::dynamic_bitset<> _mask;
     int _gapped;
+    // the sequence packed under the last encoding asked for (_packedWith[0]
+    // is -1 before the first)
+    PackedSequence _packed;
+    int _packedWith[4];
 };
 
+// A seed hit placed against the references: where the hash is expected
+// (in a set of references, in bits), where it was observed in the read (in
+// bits) and the diagonal that implies (in bases).
 typedef struct {
-  Hash hash;
+  int hash;
+  int references;
   int expected_position;
   int observed_position;
   int offset;
 } hash_info;
 
-bool operator<(const hash_info lhs, const hash_info rhs) {
+inline bool operator<(const hash_info &lhs, const hash_info &rhs) {
   return lhs.observed_position < rhs.observed_position;
 }
 
+// A candidate reference for a read: the read's base i lines up with the
+// reference's base i - offset, on the evidence of hits seeds.
+typedef struct {
+  int reference;
+  int offset;
+  int hits;
+} reference_hit;
+
+// The best colinear chain of seed hits for a reference: the diagonals it
+// runs along, in bases, and its score (hits, less the cost of changing
+// diagonal).
+typedef struct {
+  int reference;
+  int low;
+  int high;
+  int score;
+} reference_chain;
+
+
+// What a set of seeds costs and what it finds, for tuning them: the size of
+// its index and the seed hits expected on a read.
+typedef struct {
+  unsigned int width;  // in bits
+  int hashes;
+  size_t bytes;        // seed tables and grouped postings
+  double probes;       // table lookups for a read of the length given
+  double hits;         // on a read of a whole reference, at the error rate given
+  double random;       // on an unrelated read of the length given
+} seed_design;
+
+// A place (in bits) a hash is at, in every reference of a set.
+typedef struct {
+  int place;
+  int set;
+} hash_group;
+
+// The seed index file: everything matching and chaining reads need, with
+// no sequences. The sections are laid out by MappedWriter.
+#define REFERENCE_FILE_MAGIC "HASHIDX3"
+
+typedef struct {
+  char magic[8];
+  int32_t encoding[4];
+  uint32_t width;       // hash width, in bits
+  uint32_t hashes;
+  uint32_t references;
+  uint32_t window;      // minimizer sampling, 0 for none
+  uint32_t kmer;
+  mapped_section tables;
+  mapped_section slots;
+  mapped_section filters;
+  mapped_section groupStart;
+  mapped_section groups;
+  mapped_section setStart;
+  mapped_section sets;
+  mapped_section setsOfStart;
+  mapped_section setsOf;
+  mapped_section nameStart;
+  mapped_section names;
+} reference_file_header;
 
 class ReferenceSet {
     public:
       ReferenceSet();
-      ReferenceSet(std::vector<int> enc, std::set<Hash> h){ _encoding = enc; _hashes = std::vector<Hash>(h.begin(), h.end()); }
-      void insert(Reference r);
-      void match(Sequence);
+      ReferenceSet(const std::vector<int>&, const std::set<Hash>&, unsigned int = 0, unsigned int = 0);
+      void insert(const Reference &r);
+      void insert(const Sequence &s);
+      bool save(const char*);
+      bool load(const char*);
+      void seed(Sequence&, std::vector<seed_hit>&);
+      std::vector<reference_hit> match(Sequence&);
+      void match(Sequence&, std::vector<reference_hit>&);
+      std::vector<reference_chain> chain(Sequence&);
+      seed_design design(double, int);
+      const seed_probe_counts& probeCounts() const { return _index.counts(); }
+      void resetProbeCounts(){ _index.resetCounts(); }
+      int size() const { return _count; }
+      const char* getName(int);
+      Reference& getReference(int ii){ return _references[ii]; }
     private:
       std::vector<int> _encoding;
-      std::set<Reference> _references;
+      std::vector<Reference> _references; // empty once loaded
       std::vector<Hash> _hashes;
+      void group();
+      void clear();
+      SeedIndex _index;
+      // A sampled set's index holds the hashes found on minimizers; every
+      // hash is placed in the references through this one, and _indexed
+      // counts the references each hash was indexed from.
+      SeedIndex _placing;
+      std::vector<int> _indexed;
+      int _count;
+      unsigned int _width;
+      // for each hash, the references it's unique in and where (in bits)
+      std::vector< std::vector< std::pair<int, int> > > _postings;
+      // The same, grouped: the places each hash is at and the set of
+      // references it's at there, hash i's in [_groupStart[i],
+      // _groupStart[i + 1]). Sets, and the sets of each reference, are laid
+      // out the same way. Built on demand and cleared by insert, or mapped
+      // from a file by load.
+      FlatArray<int> _groupStart;
+      FlatArray<hash_group> _groups;
+      FlatArray<int> _setStart;
+      FlatArray<int> _sets;
+      FlatArray<int> _setsOfStart;
+      FlatArray<int> _setsOf;
+      FlatArray<int> _nameStart;
+      FlatArray<char> _names;
+      boost::shared_ptr<MappedFile> _file;
+      // kept between reads by match
+      std::vector<seed_hit> _hits;
+      std::vector< std::pair<int, int> > _offsetSets;
+      std::vector<int> _referenceHits;    // by reference, zero between offsets
+      std::vector<int> _touched;
 };
 
 class Reference {
   public:
-    Reference(Sequence, std::list<Hash>, std::vector<int>);
-    bool operator<(const Reference) const;
+    Reference(const Sequence&, const std::list<Hash>&, const std::vector<int>&);
+    Reference(const Sequence&, SeedIndex&, const std::vector<Hash>&, const std::vector<int>&);
+    bool operator<(const Reference&) const;
+    const std::string& getName() const { return _ref.getName(); }
+    const std::vector< std::pair<Hash, int> >& getPositions() const { return _positions; }
   private:
+    void place(SeedIndex&, const std::vector<Hash>&, const std::vector<int>&);
     Sequence _ref;
     boost::dynamic_bitset<> _refbits;
-    std::map<Hash, int> _positions;
+    // the hashes found exactly once in the reference and where (in bits),
+    // in hash order
+    std::vector< std::pair<Hash, int> > _positions;
 };
+
+#endif
@@ -3,27 +3,41 @@
 using namespace boost;
 using namespace std;
 
-Hash::Hash(dynamic_bitset<> mask, dynamic_bitset<> val){
-  _id = HID++;
+unsigned int HID = 0;
+
+// A hash is the low `size` bits of a window: where the invariant bits are
+// (mask) and what they are (val).
+Hash::Hash(uint64_t mask, uint64_t val, unsigned int size){
+  _id = hashIds(1);
+  _value = val & mask;
+  _mask = mask;
+  _size = size;
+}
+
+// The same, with an id already handed out by hashIds.
+Hash::Hash(uint64_t mask, uint64_t val, unsigned int size, unsigned int id){
+  _id = id;
   _value = val & mask;
   _mask = mask;
-  _size = mask.size();
+  _size = size;
 }
 
-bool Hash::operator<(const Hash rhs) const {
-  return (_value & _mask) < (rhs._value & rhs._mask);
+// Order by value, then mask; hashes with the same masked value but
+// different masks are distinct.
+bool Hash::operator<(const Hash &rhs) const {
+  return _value < rhs._value || (_value == rhs._value && _mask < rhs._mask);
 }
 
-bool Hash::operator>(const Hash rhs) const {
-  return (_value & _mask) > (rhs._value & rhs._mask);
+bool Hash::operator>(const Hash &rhs) const {
+  return rhs < *this;
 }
 
-bool Hash::match(dynamic_bitset<> t){
+bool Hash::match(uint64_t t) const {
   return (_value == (t & _mask));
 }
 
-bool Hash::match(dynamic_bitset<> val, dynamic_bitset<> valmask){
-  if( _mask.is_subset_of(valmask) ){
+bool Hash::match(uint64_t val, uint64_t valmask) const {
+  if( (_mask & ~valmask) == 0 ){
     return (_value == (val & _mask));
   } else {
     return false;
@@ -32,10 +46,10 @@ bool Hash::match(dynamic_bitset<> val, dynamic_bitset<> valmask){
 
 // HashSet
 HashSet::HashSet(){
-
+    _size = 0;
 }
 
-bool HashSet::insert(Hash h){
+bool HashSet::insert(const Hash &h){
 
     if( _hashes.size() ){
         assert(h.size() == _size );
@@ -43,41 +57,30 @@ bool HashSet::insert(Hash h){
         _size = h.size();
     }
     
-    return (_hashes.insert(h)).second;
+    if( !(_hashes.insert(h)).second ){
+        return false;
+    }
+    _index.insert(h.getMask(), h.getValue(), h.size(), h.id());
+    return true;
 }
 
-void HashSet::match(dynamic_bitset<> val, dynamic_bitset<> mask, multimap<int,int> &matches, int pos){
-    set<Hash>::iterator h_itr;
-
-    for(h_itr = _hashes.begin(); h_itr != _hashes.end(); h_itr++){
-        Hash h = *h_itr;
-        if(h.match(val, mask)){
-            int ids = h.id();
-            matches.insert(pair<int, int>(pos, ids));
-        }
-    }
-    return;
+// Append a hit for every place a hash matches the read. Nothing is
+// allocated once hits has room for them.
+void HashSet::match(const PackedSequence &read, vector<seed_hit> &hits){
+    _index.match(read, hits);
 }
 
-multimap<int, int> HashSet::matchAll(Sequence seq){
+// The same, keyed by position.
+multimap<int, int> HashSet::matchAll(const Sequence &seq){
 
     multimap<int, int> res;
-    dynamic_bitset<> eseq = seq.getEncoded();
-    unsigned int seqlen = eseq.size();
-
-    dynamic_bitset<> val_set;
-    dynamic_bitset<> mask_set;
+    vector<seed_hit> hits;
 
-    // Buffer
-    for( unsigned int ii = 0; ii < _size; ii++ ){
-      val_set.push_back(eseq[_size-ii-1]);
-      mask_set.push_back(1);
-    }
+    match(seq.getPacked(), hits);
 
-    for( unsigned int ii = 0; ii < seqlen - _size; ii++ ){
-        match(val_set, mask_set, res, ii);
-        val_set >>= 1;
-        val_set[_size-1] = eseq[_size+ii];
+    vector<seed_hit>::iterator h_itr;
+    for( h_itr = hits.begin(); h_itr != hits.end(); h_itr++ ){
+        res.insert(pair<int, int>(h_itr->position, h_itr->id));
     }
 
     return res;
@@ -109,16 +112,9 @@ Sequence::Sequence(kseq_t* kseq){
     _qual = "";   
   };
 
-  _gapMask = dynamic_bitset<>(len*2);
-
-  // construct the mask
-  string::iterator s_itr;
-  for( s_itr = _seq.begin(); s_itr != _seq.end(); s_itr++ ){
-    _gapMask <<= 2;
-    if( isNucleotide(*s_itr) ){
-      _gapMask |= dynamic_bitset<>(2,3);
-    }
-  }
+  // encode the sequence two bits per base and construct the matching mask
+  int codes[] = {A, T, C, G};
+  _packed = PackedSequence(_seq, codes);
 }
 
 // MultipleSequenceAlign
@@ -129,160 +125,244 @@ void MultipleSequenceAlign::reset(){
     _mask.clear();
 }
 
-// Insert a sequence into the multiple sequence alignment
+// Insert a sequence into the multiple sequence alignment; -1 if it's not
+// as long as the rows already in, counted or not.
 int MultipleSequenceAlign::insert(kseq_t *kseq){
   Sequence seq(kseq);
+  if( !_sequences.empty() && seq.getSeq().size() != _sequences[0].getSeq().size() ){
+    fprintf(stderr, "A row of %lu columns doesn't fit an alignment of %lu\n",
+            (unsigned long) seq.getSeq().size(), (unsigned long) _sequences[0].getSeq().size());
+    return -1;
+  }
+  if( !_columns.empty() && !_columns.add(seq.getSeq()) ){
+    return -1;
+  }
+  _names.insert(make_pair(seq.getName(), (int) _sequences.size()));
   _sequences.push_back(seq);
   reset();
   return _sequences.size();
 }
 
-bool MultipleSequenceAlign::remove(string seq){
-  vector<Sequence>::iterator s_itr;
-  for(s_itr = _sequences.begin(); s_itr != _sequences.end(); s_itr++){
-    if( s_itr->getName() == seq ){
-      _sequences.erase(s_itr);
-      reset();
-      return true;
-    }
+// The last row takes the place of the one removed.
+bool MultipleSequenceAlign::remove(const string &seq){
+  // the first row by that name, as a scan would find
+  pair<unordered_multimap<string, int>::iterator, unordered_multimap<string, int>::iterator> range;
+  range = _names.equal_range(seq);
+  if( range.first == range.second ){
+    return false;
   }
-  return false;
-}
 
-dynamic_bitset<> MultipleSequenceAlign::getGaps(){
-  if( _gaps.size() > 0){
-    return _gaps;
+  unordered_multimap<string, int>::iterator n_itr = range.first;
+  unordered_multimap<string, int>::iterator first_itr;
+  for( first_itr = range.first; first_itr != range.second; first_itr++ ){
+    if( first_itr->second < n_itr->second ){
+      n_itr = first_itr;
+    }
   }
 
-  dynamic_bitset<> mask(0);
-  if( _sequences.size() ){
-    mask = _sequences[0].getMask();
+  int row = n_itr->second;
+  int last = _sequences.size() - 1;
+  _names.erase(n_itr);
+
+  // counted again when next needed if the row doesn't fit
+  if( !_columns.empty() && !_columns.remove(_sequences[row].getSeq()) ){
+    _columns.clear();
+  }
 
-    vector<Sequence>::iterator s_itr = _sequences.begin() + 1;
-    for( ; s_itr != _sequences.end(); s_itr++ ){
-      mask &= s_itr->getMask();
+  if( row != last ){
+    range = _names.equal_range(_sequences[last].getName());
+    for( n_itr = range.first; n_itr != range.second; n_itr++ ){
+      if( n_itr->second == last ){
+        n_itr->second = row;
+        break;
+      }
     }
+    _sequences[row] = _sequences[last];
   }
+  _sequences.pop_back();
 
-  _gaps = mask;
-  return mask;
+  reset();
+  return true;
 }
 
-dynamic_bitset<> MultipleSequenceAlign::getConsensus(){
-    if( _consensus.size() > 0 ){
-        return _consensus;
+// Counted in one pass the first time they're needed.
+const ColumnCounts& MultipleSequenceAlign::countColumns(){
+  if( _columns.empty() && _sequences.size() ){
+    vector<const string*> rows;
+    vector<Sequence>::iterator s_itr;
+    for( s_itr = _sequences.begin(); s_itr != _sequences.end(); s_itr++ ){
+      rows.push_back(&s_itr->getSeq());
     }
+    _columns.count(rows);
+  }
+  return _columns;
+}
+
+dynamic_bitset<> MultipleSequenceAlign::getGaps(){
+  if( _gaps.size() > 0){
+    return _gaps;
+  }
 
-    dynamic_bitset<> consensus(0);
-  if( _sequences.size() ){
-    consensus = _sequences[0].getEncoded();
+  int codes[] = {A, T, C, G};
+  vector<uint64_t> gaps;
+  const ColumnCounts &columns = countColumns();
+  columns.derive(codes, NULL, &gaps, NULL);
 
-    vector<Sequence>::iterator s_itr = _sequences.begin() + 1;
-    for( ; s_itr != _sequences.end(); s_itr++ ){
-      consensus &= s_itr->getEncoded();
-    }
+  _gaps = packedBits(gaps, 2 * columns.columns());
+  return _gaps;
+}
+
+// The AND of every row's encoding.
+dynamic_bitset<> MultipleSequenceAlign::getConsensus(){
+  if( _consensus.size() > 0 ){
+    return _consensus;
   }
 
-  _consensus = consensus;
-  return consensus;
+  int codes[] = {A, T, C, G};
+  vector<uint64_t> consensus;
+  const ColumnCounts &columns = countColumns();
+  columns.derive(codes, &consensus, NULL, NULL);
+
+  _consensus = packedBits(consensus, 2 * columns.columns());
+  return _consensus;
 }
 
+// The bits every row agrees on, outside gaps.
 dynamic_bitset<> MultipleSequenceAlign::getMask(){
-    if( _mask.size() > 0 ){
-        return _mask;
-    }
+  if( _mask.size() > 0 ){
+    return _mask;
+  }
 
-    dynamic_bitset<> prev = _sequences[0].getEncoded();
-    dynamic_bitset<> accumulator = dynamic_bitset<>(prev.size());
-    accumulator.flip();
+  int codes[] = {A, T, C, G};
+  vector<uint64_t> mask;
+  const ColumnCounts &columns = countColumns();
+  columns.derive(codes, NULL, NULL, &mask);
 
+  _mask = packedBits(mask, 2 * columns.columns());
+  return _mask;
+}
 
-    vector<Sequence>::iterator s_itr = _sequences.begin() + 1;
-    for( ; s_itr != _sequences.end(); s_itr++ ){
-        dynamic_bitset<> curr = s_itr->getEncoded();
-        accumulator -= (curr ^ prev);
-        prev = curr;
+typedef struct {
+    const SeedPattern *pattern;
+    const vector<uint64_t> *consensus;
+    const vector<uint64_t> *gaps;
+    const vector<uint64_t> *mask;
+    hash_window *windows;
+} hash_task;
+
+// The seed at every window in [begin, end), if there is one.
+static void hashBlock(int begin, int end, void *arg){
+  hash_task *task = (hash_task*) arg;
+  unsigned int width = task->pattern->width();
+  uint64_t full = (width < 64 ? (1ULL << width) - 1 : ~0ULL);
+
+  for( int ii = begin; ii < end; ii++ ){
+    uint64_t hashMask     = packedWindow(*task->mask, ii, width) & task->pattern->care(); // tell us /where/ the invariant bits are in the hash
+    uint64_t hashSequence = packedWindow(*task->consensus, ii, width); // tell us /what/ the invariant bits are in the hash
+    uint64_t gapWindow    = packedWindow(*task->gaps, ii, width);      // Is there a gap here?
+
+    hash_window &w = task->windows[ii];
+    w.value = hashSequence & hashMask;
+    w.mask = hashMask;
+    w.position = -1;
+
+    // The least significant bit is unmasked and we aren't in a gap
+    if( (hashMask & 1) && gapWindow == full && __builtin_popcountll(hashMask) >= (int) task->pattern->minimum() ){
+      w.position = ii;
     }
+  }
+}
+
+static bool byHashWindow(const hash_window &lhs, const hash_window &rhs){
+  if( lhs.value != rhs.value ){ return lhs.value < rhs.value; }
+  if( lhs.mask != rhs.mask ){ return lhs.mask < rhs.mask; }
+  return lhs.position < rhs.position;
+}
 
-    dynamic_bitset<> gaps = getGaps();
-    accumulator &= gaps;
-    _mask = accumulator;
-    return accumulator;
+static bool sameHash(const hash_window &lhs, const hash_window &rhs){
+  return lhs.value == rhs.value && lhs.mask == rhs.mask;
 }
 
-HashSet MultipleSequenceAlign::makeHashes(){
+// Seeds of the pattern's shape, at every offset where the first bit is
+// informative and the window spans no gap; those found more than once are
+// dropped. The windows are independent, so they're split across threads;
+// then one sort brings duplicates together and a sweep drops them. Ids go
+// to the seeds kept in the order of their windows, whatever the threads.
+HashSet MultipleSequenceAlign::makeHashes(const SeedPattern &pattern, int threads){
   
   HashSet hs;
-  multiset<Hash> h;
   
-  int hash_length = 24;
-
-  dynamic_bitset<> consensus = getConsensus();
-  dynamic_bitset<> gaps      = getGaps();
-  dynamic_bitset<> mask      = getMask();
-
-  int len = mask.size();
+  unsigned int hash_length = pattern.width();
+  if( !pattern.valid() ){
+    return hs;
+  }
 
-  dynamic_bitset<> hashMask(hash_length);     // tell us /where/ the invariant bits are in the hash
-  dynamic_bitset<> hashSequence(hash_length); // tell us /what/ the invariant bits are in the hash
+  int codes[] = {A, T, C, G};
+  vector<uint64_t> consensus, gaps, mask;
+  const ColumnCounts &columns = countColumns();
+  columns.derive(codes, &consensus, &gaps, &mask);
 
-  dynamic_bitset<> gapWindow(hash_length); // Is there a gap here?
-  // buffer
-  for( int ii = 0; ii < hash_length; ii++ ){
-    hashMask[ii]     = mask[ii];
-    hashSequence[ii] = consensus[ii];
-    gapWindow[ii]    = gaps[ii];
+  unsigned int len = 2 * columns.columns();
+  if( len < hash_length ){
+    return hs;
   }
 
-  for( int ii = hash_length; ii < len; ii++ ){
-      // The least significant bit is unmasked and we aren't in a gap
-      if( hashMask[0] && (~gapWindow).none() ){
-         Hash hash(hashMask, hashSequence);
-         h.insert(hash);
-      }
-
-      // right shift everything dumping the least significant bit
-      hashMask     >>= 1;
-      hashSequence >>= 1;
-      gapWindow    >>= 1;
-      
-      // reset the most significant bit
-      hashMask[hash_length - 1] = mask[ii];
-      hashSequence[hash_length - 1] = consensus[ii];
-      gapWindow[hash_length - 1] = gaps[ii];
+  vector<hash_window> windows(len - hash_length + 1);
+  hash_task task;
+  task.pattern = &pattern;
+  task.consensus = &consensus;
+  task.gaps = &gaps;
+  task.mask = &mask;
+  task.windows = &windows[0];
+  parallelFor(windows.size(), threads, hashBlock, &task);
+
+  // keep the windows that gave a seed, and bring equal seeds together
+  unsigned int n = 0;
+  for( unsigned int ii = 0; ii < windows.size(); ii++ ){
+    if( windows[ii].position >= 0 ){
+      windows[n++] = windows[ii];
+    }
+  }
+  windows.resize(n);
+  sort(windows.begin(), windows.end(), byHashWindow);
+
+  // Remove duplicates: a seed is kept if its run is one long
+  vector<int> rank(len, -1);
+  for( unsigned int ii = 0; ii < n; ii++ ){
+    if( (ii == 0 || !sameHash(windows[ii - 1], windows[ii])) && (ii + 1 == n || !sameHash(windows[ii], windows[ii + 1])) ){
+      rank[windows[ii].position] = 0;
+    }
   }
 
-  multiset<Hash>::iterator h_itr;
+  // number the kept ones by window
+  unsigned int kept = 0;
+  for( unsigned int ii = 0; ii < len; ii++ ){
+    if( rank[ii] == 0 ){
+      rank[ii] = ++kept;
+    }
+  }
+  unsigned int first = hashIds(kept);
 
-  // Remove duplicates
-  for( h_itr = h.begin() ; h_itr != h.end(); h_itr++ ){
-    if(h.count(*h_itr) == 1){
-        hs.insert(*h_itr);
+  for( unsigned int ii = 0; ii < n; ii++ ){
+    int r = rank[windows[ii].position];
+    if( r > 0 ){
+      hs.insert(Hash(windows[ii].mask, windows[ii].value, hash_length, first + r - 1));
     }
   }
 
   return hs;
 }
 
+#ifndef NO_MAIN
 int main(int argc, char *argv[])
 {
 
-  dynamic_bitset<> hash(5);
-  hash[0] = 1;
-  hash[1] = 1;
-  hash[4] = 1;
-  dynamic_bitset<> mask(5);
-  mask[0] = 1;
-  mask[1] = 1;
-  mask[4] = 1;
-  dynamic_bitset<> val(5);
-  val[0] = 1;
-  val[1] = 1;
-  val[2] = 1;
-  val[3] = 0;
-  val[4] = 1;
-  Hash h(mask, hash);
+  uint64_t hash = 0x13; // 10011
+  uint64_t mask = 0x13; // 10011
+  uint64_t val  = 0x17; // 10111
+  Hash h(mask, hash, 5);
+  h.match(val);
 
   return 0;
 }
-
+#endif
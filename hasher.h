@@ -1,14 +1,22 @@
+#ifndef _HASHER_H_
+#define _HASHER_H_
+
 #include <limits.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <zlib.h>
+#include "columns.h"
 #include "kseq.h"
+#include "packed.h"
+#include "seedindex.h"
 
 #include <algorithm>
 #include <list>
 #include <map>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <boost/dynamic_bitset.hpp>
@@ -21,35 +29,47 @@ class Hash;
 class HashSet;
 class Sequence;
 
-unsigned int HID = 0;
+// Hash ids are unique across the program; hashIds(n) hands out n in a row,
+// and is safe to call from any thread.
+extern unsigned int HID;
+inline unsigned int hashIds(unsigned int n){ return __sync_fetch_and_add(&HID, n); }
+
 class Hash {
     public:
         Hash();
-        Hash(boost::dynamic_bitset<>, boost::dynamic_bitset<>);
+        Hash(uint64_t, uint64_t, unsigned int);
+        Hash(uint64_t, uint64_t, unsigned int, unsigned int);
         ~Hash(){};
-        bool match(boost::dynamic_bitset<>);
-        bool match(boost::dynamic_bitset<>, boost::dynamic_bitset<>);
-        bool operator<(const Hash) const;
-        bool operator>(const Hash) const;
-        unsigned int id(){ return _id; }
-        unsigned int size(){ return _size; }
-        boost::dynamic_bitset<> getMask(){ return _mask; }
+        bool match(uint64_t) const;
+        bool match(uint64_t, uint64_t) const;
+        bool operator<(const Hash&) const;
+        bool operator>(const Hash&) const;
+        unsigned int id() const { return _id; }
+        unsigned int size() const { return _size; }
+        uint64_t getMask() const { return _mask; }
+        uint64_t getValue() const { return _value; }
     private:
         unsigned int _id;
         unsigned int _size;
-        boost::dynamic_bitset<> _mask;
-        boost::dynamic_bitset<> _value;
+        uint64_t _mask;
+        uint64_t _value;
 };
 
 class HashSet {
     public:
         HashSet();
-        bool insert(Hash);
-        void match(boost::dynamic_bitset<>, boost::dynamic_bitset<>, std::multimap<int, int>&, int);
-        std::multimap<int, int> matchAll(Sequence);
-        int size(){ return _size; }
+        bool insert(const Hash&);
+        void match(const PackedSequence&, std::vector<seed_hit>&);
+        std::multimap<int, int> matchAll(const Sequence&);
+        int size() const { return _size; }
+        int count() const { return _hashes.size(); }
+        int tables(){ return _index.tables(); }
+        const std::set<Hash>& getHashes() const { return _hashes; }
+        const seed_probe_counts& probeCounts() const { return _index.counts(); }
+        void resetProbeCounts(){ _index.resetCounts(); }
     private:
         std::set<Hash> _hashes;
+        SeedIndex _index;
         unsigned int _size;
 };
 
@@ -57,32 +77,18 @@ class Sequence {
     public:
         Sequence(kseq_t*);
         Sequence ungap();
-        boost::dynamic_bitset<> getEncoded(){ return _seqbits; }
-        boost::dynamic_bitset<> getMask(){ return _gapMask; }
-        std::string getName(){ return _name; }
+        boost::dynamic_bitset<> getEncoded() const { return _packed.getBits(); }
+        boost::dynamic_bitset<> getMask() const { return _packed.getMask(); }
+        const PackedSequence& getPacked() const { return _packed; }
+        const std::string& getName() const { return _name; }
+        const std::string& getSeq() const { return _seq; }
     private:
-
-        inline bool isNucleotide(char n){
-            switch(n){
-                case 'A':
-                case 'a':
-                case 'T':
-                case 't':
-                case 'C':
-                case 'c':
-                case 'G':
-                case 'g': return true;
-                default: return false;
-            }
-        }
-
         std::string _name;
         std::string _comment;
         std::string _seq;
         std::string _qual;
-        boost::dynamic_bitset<> _seqbits;
+        PackedSequence _packed;
         boost::dynamic_bitset<> _qualityMask;
-        boost::dynamic_bitset<> _gapMask;
 };
 /*
 class Reference : public Sequence {
@@ -93,26 +99,39 @@ class Reference : public Sequence {
 };
 */
 
+// A seed taken at a window of an alignment, before duplicates are dropped.
+typedef struct {
+    uint64_t value;
+    uint64_t mask;
+    int position;   // bit offset of the window; -1 if it gives no seed
+} hash_window;
+
 class MultipleSequenceAlign { 
     public:
         MultipleSequenceAlign(){};
         ~MultipleSequenceAlign(){};
         int insert(kseq_t* s);
-        bool remove(std::string);
+        bool remove(const std::string&);
         std::vector<int> getMinimalEncoding();
         boost::dynamic_bitset<> getMask();
         boost::dynamic_bitset<> getGaps();
         boost::dynamic_bitset<> getConsensus();
-        HashSet makeHashes();
+        HashSet makeHashes(const SeedPattern& = SeedPattern(), int = 1);
     private:
         //Member functions
         void reset();
+        const ColumnCounts& countColumns();
         //Member variables
         std::vector<Sequence> _sequences;
+        // row of every name
+        std::unordered_multimap<std::string, int> _names;
+        // Built on demand, then kept up to date by insert and remove; the
+        // bitsets below are derived from it.
+        ColumnCounts _columns;
         boost::dynamic_bitset<> _consensus;
         boost::dynamic_bitset<> _gaps;
         boost::dynamic_bitset<> _mask;
         int _length;
 };
 
-
+#endif
@@ -4,6 +4,8 @@
 
 using namespace std;
 
+const double PHRED_TABLE[] = {0.5};
+
 // HMM
 
 HMM::HMM(const char* fn){
@@ -14,7 +16,7 @@ HMM::HMM(const char* fn){
     TiXmlElement* root = doc.RootElement();
 
     // Instantiate the start state
-    int start;
+    int start = 0; // models without a start attribute begin at state 0
     root->Attribute("start", &start);
 
     for( TiXmlElement* e = root->FirstChildElement(); e; e = e->NextSiblingElement() ){
@@ -56,6 +58,16 @@ void HMM::setTransitions(){
 HMM::~HMM(){ }
 
 char* HMM::generate(int request_length){
+    return generate(request_length, _rng);
+}
+
+// If path is given, it receives the id of the state behind every emitted base.
+// If diagonals is, it receives the diagonal (emission - position, as in
+// search_band) annotate puts every base on when it follows the same states.
+// That's not the base's index: annotate's emission count moves on once more
+// for every state that emits nothing, the start state included, and a
+// state that both resets and increments the position leaves it at 0 there.
+char* HMM::generate(int request_length, MTRand &rng, vector<int> *path, vector<int> *diagonals){
 
     char* res = (char*) calloc(request_length + 1, sizeof(char));
     //I don't need to set the null terminator on res, calloc does that for me.
@@ -65,35 +77,164 @@ char* HMM::generate(int request_length){
     double tp = 0.0;
     int ii = 0;
     int position = 0;
+    int emission = 0;   // annotate's, and its position
+    int searchPosition = 0;
     while( ii < request_length ){
-        ep = _rng.rand();
-        tp = _rng.rand();
+        ep = rng.rand();
+        tp = rng.rand();
 
         if( s->hasEmission() ){
             res[ii] = s->emit(ep, position);
+            if( path ){
+                path->push_back(s->getId());
+            }
+            if( diagonals ){
+                diagonals->push_back(emission - searchPosition);
+            }
             ii++;
         }
 
+        // as annotate moves a node on, and enqueueBehavior its successors
+        if( s->incrementing() ){
+            emission++;
+        }
+        if( !s->hasEmission() ){
+            emission++;
+        }
+        bool indexed = s->indexed(), reset = s->resetting(), increment = s->incrementing();
+
         if( s->hasTransition() ){
             s = s->transition(tp, position);
         } else {
             //If we don't have a valid transition, die
             return res;
         }
+
+        if( indexed ){
+            searchPosition = position;
+        } else if( reset ){
+            searchPosition = 0;
+        } else if( increment ){
+            searchPosition++;
+        }
     }
     return res;
 }
 
+// splitmix64's output function: every input bit reaches every output bit,
+// and distinct inputs give distinct outputs.
+static inline uint64_t splitmix64(uint64_t x){
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Seed-splitting: every read gets its own generator, seeded from the
+// (master seed, stream) pair. A read's content depends only on its stream
+// number, never on which thread produced it or in what order. All 64 bits
+// of both are mixed into the key, so no two pairs share a generator.
+MTRand HMM::seedStream(unsigned long seed, unsigned long stream){
+    uint64_t a = splitmix64(seed);
+    uint64_t b = splitmix64(a ^ stream);
+    MTRand::uint32 key[4];
+    key[0] = a & 0xffffffffUL;
+    key[1] = a >> 32;
+    key[2] = b & 0xffffffffUL;
+    key[3] = b >> 32;
+    return MTRand(key, 4);
+}
+
+typedef struct {
+    HMM *hmm;
+    std::vector<char*> *reads;
+    int length;
+    unsigned long seed;
+    unsigned long first;
+} generate_task;
+
+static void generateBlock(int begin, int end, void *arg){
+    generate_task *task = (generate_task*) arg;
+    for( int ii = begin; ii < end; ii++ ){
+        MTRand rng = HMM::seedStream(task->seed, task->first + ii);
+        (*task->reads)[ii] = task->hmm->generate(task->length, rng);
+    }
+}
+
+// Generate `count` reads of `request_length`; read ii is drawn from stream
+// first + ii, so the output is identical for any number of threads.
+vector<char*> HMM::generate(int count, int request_length, unsigned long seed, int threads, unsigned long first){
+
+    vector<char*> reads(count, (char*) NULL);
+
+    generate_task task;
+    task.hmm = this;
+    task.reads = &reads;
+    task.length = request_length;
+    task.seed = seed;
+    task.first = first;
+
+    parallelFor(count, threads, generateBlock, &task);
+    return reads;
+}
+
 void HMM::viterbi(char *seq, char *qual){
 
+    search_stats stats;
+    list<string> labels = annotate(seq, qual, &stats);
+
+    if( stats.found ){
+        printf("Last node: %d, %d, %d\n", stats.lastState, stats.lastEmission, stats.lastPosition);
+        printf("Searched: %d\tQueue size: %d\n", stats.searched, stats.queueSize);
+    }
+
+    list<string>::iterator lb_itr;
+    for( lb_itr = labels.begin() ; lb_itr != labels.end() ; lb_itr++ ){
+        printf("%s\n", (*lb_itr).c_str());
+    }
+}
+
+// Find the most likely path through the model for seq, returning the
+// labels along it. Search counters are reported through stats, if given.
+//
+// bands, if given, are the seeding's verdict on the read: each confines an
+// IndexedState to a band around the diagonal the read was placed on (see
+// search_band), and IndexedStates without one are left out of the search.
+// Hints for any other kind of state are ignored. Should the banded search
+// not reach the end of the read, it is run again without them.
+list<string> HMM::annotate(const char *seq, const char *qual, search_stats *stats, const vector<search_band> *bands){
+
     int len = strlen(seq); 
     int numSearched = 0;
+    int peakQueue = 0;
+    bool found = false;
     SearchQueue dijkstraQueue;
     list<vsearch_entry<VState*>* > expandedNodes;
-    set<pair<int, pair<int, int> > > searchedNodes;
+    list<string> labels;
 
+    if( stats ){
+        stats->found = false;
+        stats->fellBack = false;
+    }
+
+    if( bands ){
+        vector<VState*>::iterator st_itr;
+        for( st_itr = _states.begin(); st_itr != _states.end(); st_itr++ ){
+            if( (*st_itr)->indexed() ){
+                dijkstraQueue.band(*st_itr, 0, -1);
+            }
+        }
+
+        vector<search_band>::const_iterator b_itr;
+        for( b_itr = bands->begin(); b_itr != bands->end(); b_itr++ ){
+            assert( b_itr->state >= 0 && b_itr->state < (int) _states.size() );
+            VState *st = _states[b_itr->state];
+            if( st->indexed() ){
+                dijkstraQueue.band(st, b_itr->offset, b_itr->width);
+            }
+        }
+    }
 
-    vsearch_entry<VState*>* lastNode = NULL;
     vsearch_entry<VState*> *head = new vsearch_entry<VState*>();
     head->state = _startState;
     head->incoming = NULL;
@@ -102,6 +243,8 @@ void HMM::viterbi(char *seq, char *qual){
     head->loglikelihood.v = 0.0;
 
     dijkstraQueue.push(head);
+    HMM_STAT(allocated, 1);
+    HMM_STAT(pushes, 1);
 
     while( !dijkstraQueue.empty() ){
 
@@ -110,23 +253,29 @@ void HMM::viterbi(char *seq, char *qual){
         vsearch_entry<VState*> *node = node_wrapper.getEntry();
         expandedNodes.push_back(node);
         dijkstraQueue.pop();
+        HMM_STAT(pops, 1);
 
-        pair<int, pair<int, int> > ndid(node->state->getId(), pair<int,int>(node->emission, node->position));
+        if( node->siblings ){
+            node->siblings->enqueueSibling(dijkstraQueue, node);
+        }
 
-        if( searchedNodes.count(ndid) ){
+        if( !dijkstraQueue.close(node->state, node->emission, node->position) ){
+            HMM_STAT(duplicates, 1);
             continue;
-        } else {
-            searchedNodes.insert(ndid);
         }
 
         //printf("<%d, %d, %d>: %e [%c]\n", node->state->getId(), node->emission, node->position, node->loglikelihood.v, seq[node->emission]);
 
-        list<string> labels;
-
         if( node->emission >= len ){
-            printf("Last node: %d, %d, %d\n", node->state->getId(), node->emission, node->position);
-            printf("Searched: %d\tQueue size: %d\n", numSearched, dijkstraQueue.size());
-        
+            found = true;
+            if( stats ){
+                stats->found = true;
+                stats->lastState = node->state->getId();
+                stats->lastEmission = node->emission;
+                stats->lastPosition = node->position;
+                stats->loglikelihood = node->loglikelihood.v;
+            }
+
             do{
                 VState *st = node->state;
                 string lb = st->getLabel();
@@ -135,15 +284,7 @@ void HMM::viterbi(char *seq, char *qual){
                 }
             } while( node->incoming && (node = node->incoming) );
 
-            list<string>::iterator lb_itr;
-            for( lb_itr = labels.begin() ; lb_itr != labels.end() ; lb_itr++ ){
-                printf("%s\n", (*lb_itr).c_str());
-            }
-
-
-            list<vsearch_entry<VState*>* >::iterator sl_itr = expandedNodes.begin();
-
-            return;
+            break;
         }
 
         logdouble ep;
@@ -167,8 +308,42 @@ void HMM::viterbi(char *seq, char *qual){
 
         node->loglikelihood = node->loglikelihood + ep;
         node->state->enqueueTransitions(dijkstraQueue, node);
-        lastNode = node;
+        HMM_STAT_EXPAND(node->state->getId());
+
+        if( (int) dijkstraQueue.size() > peakQueue ){
+            peakQueue = dijkstraQueue.size();
+        }
     }
+
+    HMM_STAT_PEAK(peakQueue);
+    HMM_STAT_POLL();
+
+    if( stats ){
+        stats->searched = numSearched;
+        stats->queueSize = dijkstraQueue.size();
+        stats->peakQueue = peakQueue;
+    }
+
+    // Every node was either popped (and so is in expandedNodes) or is
+    // still waiting in the queue.
+    list<vsearch_entry<VState*>* >::iterator sl_itr;
+    for( sl_itr = expandedNodes.begin(); sl_itr != expandedNodes.end(); sl_itr++ ){
+        delete *sl_itr;
+    }
+    while( !dijkstraQueue.empty() ){
+        vsearch<VState*> node_wrapper = dijkstraQueue.top();
+        delete node_wrapper.getEntry();
+        dijkstraQueue.pop();
+    }
+
+    if( bands && !found ){
+        labels = annotate(seq, qual, stats, NULL);
+        if( stats ){
+            stats->fellBack = true;
+        }
+    }
+
+    return labels;
 }
 
 // HMM State
@@ -402,31 +577,39 @@ logdouble MonoBehavior<T>::loglikelihood(T emit, int qual){
 }
 
 template <class T>
-void MonoBehavior<T>::enqueueBehavior(priority_queue<vsearch<T> > &searchQueue, vsearch<T> entryWrapper, bool reset, bool increment, bool silent){
+void MonoBehavior<T>::enqueueBehavior(SearchQueueOf(T) &searchQueue, vsearch<T> entryWrapper, bool reset, bool increment, bool silent){
 
     vsearch_entry<T> *entry = entryWrapper.getEntry();
-    vsearch_entry<T> *newBehavior = new vsearch_entry<T>();
-    newBehavior->state = _emission;
-    newBehavior->incoming = entry;
+
+    int position = entry->position;
     if( reset ){
-        newBehavior->position = 0;
+        position = 0;
     } else if( increment ){
-        newBehavior->position = entry->position + 1;
+        position = entry->position + 1;
     }
 
+    int emission = (silent ? entry->emission : entry->emission + 1);
+
     logdouble r = entry->loglikelihood;
     r.v += log(_prob);
-    newBehavior->loglikelihood = r;
 
-    if( silent ){
-        newBehavior->emission = entry->emission;
-    } else {
-        newBehavior->emission = entry->emission + 1;
+    if( !searchQueue.admit(_emission, emission, position, r) ){
+        HMM_STAT(pruned, 1);
+        return;
     }
 
+    vsearch_entry<T> *newBehavior = new vsearch_entry<T>();
+    newBehavior->state = _emission;
+    newBehavior->incoming = entry;
+    newBehavior->position = position;
+    newBehavior->emission = emission;
+    newBehavior->loglikelihood = r;
+
     //printf("Adding a transition to node %d with position %d and emission %d\n", ((VState*) _emission)->getId(), newBehavior->position, newBehavior->emission);
     vsearch<T> e(newBehavior);
     searchQueue.push(e);
+    HMM_STAT(allocated, 1);
+    HMM_STAT(pushes, 1);
 }
 
 template <class T>
@@ -465,11 +648,30 @@ PolyBehavior<T>::PolyBehavior(TiXmlElement* e){
     // ensure that density is within proper bounds,
     // account for accumulated float precision loss
     assert( _density > 0.0 && _density <= 1.0000001  );
+
+    rank();
+}
+
+template <class T>
+static bool moreLikely(const pair<T, logdouble> &lhs, const pair<T, logdouble> &rhs){
+    return rhs.second < lhs.second;
+}
+
+template <class T>
+void PolyBehavior<T>::rank(){
+    _ranked.assign(_likelihoods.begin(), _likelihoods.end());
+    stable_sort(_ranked.begin(), _ranked.end(), moreLikely<T>);
 }
 
 template <class T>
 T PolyBehavior<T>::emit(double p, int position){
-    return (*_emissions.lower_bound(p)).second;
+    typename map<double, T>::iterator e_itr = _emissions.lower_bound(p);
+    // p can land above the accumulated density when the probabilities
+    // don't quite sum to 1.0; attribute the remainder to the last emission.
+    if( e_itr == _emissions.end() ){
+        return _emissions.rbegin()->second;
+    }
+    return e_itr->second;
 }
 
 template <class T>
@@ -492,33 +694,61 @@ logdouble PolyBehavior<T>::loglikelihood(T emit, int qual){
 
 }
 
+// Successors are pushed lazily: only the most likely one goes on the queue
+// now, and each popped successor pushes the next (see enqueueSibling). They
+// are ranked by descending likelihood, so none of them can be needed before
+// the one ranked above it has been popped.
 template <class T>
-void PolyBehavior<T>::enqueueBehavior(priority_queue<vsearch<T> > &searchQueue, vsearch<T> entryWrapper, bool reset, bool increment, bool silent){
+void PolyBehavior<T>::enqueueBehavior(SearchQueueOf(T) &searchQueue, vsearch<T> entryWrapper, bool reset, bool increment, bool silent){
 
     vsearch_entry<T>* entry = entryWrapper.getEntry();
-    typename map<T, logdouble>::iterator l_itr;
-    for( l_itr = _likelihoods.begin(); l_itr != _likelihoods.end(); l_itr++ ){
-        vsearch_entry<T> *newBehavior = new vsearch_entry<T>();
-        newBehavior->incoming = entry;
-        if( reset ){
-            newBehavior->position = 0;
-        } else if( increment ){
-            newBehavior->position = entry->position + 1;
-        }
 
-        if( silent ){
-            newBehavior->emission = entry->emission;
-        } else {
-            newBehavior->emission = entry->emission + 1;
-        }
+    int position = entry->position;
+    if( reset ){
+        position = 0;
+    } else if( increment ){
+        position = entry->position + 1;
+    }
+
+    int emission = (silent ? entry->emission : entry->emission + 1);
 
-        newBehavior->state = l_itr->first;
+    enqueueRanked(searchQueue, entry, emission, position, 0);
+}
+
+// Called as node is popped, before it is expanded.
+template <class T>
+void PolyBehavior<T>::enqueueSibling(SearchQueueOf(T) &searchQueue, vsearch_entry<T> *node){
+    enqueueRanked(searchQueue, node->incoming, node->emission, node->position, node->sibling + 1);
+}
+
+// Push the first successor of entry, from rank first on, that isn't
+// dominated.
+template <class T>
+void PolyBehavior<T>::enqueueRanked(SearchQueueOf(T) &searchQueue, vsearch_entry<T> *entry, int emission, int position, int first){
+
+    for( int ii = first; ii < (int) _ranked.size(); ii++ ){
         logdouble r;
         r = entry->loglikelihood;
-        r = r + l_itr->second;
+        r = r + _ranked[ii].second;
+
+        if( !searchQueue.admit(_ranked[ii].first, emission, position, r) ){
+            HMM_STAT(pruned, 1);
+            continue;
+        }
+
+        vsearch_entry<T> *newBehavior = new vsearch_entry<T>();
+        newBehavior->incoming = entry;
+        newBehavior->position = position;
+        newBehavior->emission = emission;
+        newBehavior->state = _ranked[ii].first;
         newBehavior->loglikelihood = r;
+        newBehavior->siblings = this;
+        newBehavior->sibling = ii;
         vsearch<T> e(newBehavior);
         searchQueue.push(e);
+        HMM_STAT(allocated, 1);
+        HMM_STAT(pushes, 1);
+        return;
     }
 }
 
@@ -539,6 +769,7 @@ void PolyBehavior<T>::relabelTransition(vector<T> &s){
 
     _likelihoods.clear();
     _likelihoods = newLikelihoods;
+    rank();
 }
 
 // IndexedState
@@ -570,7 +801,7 @@ logdouble IndexedBehavior<T>::loglikelihood(T emission, int position, int qual){
 }
 
 template <class T>
-void IndexedBehavior<T>::enqueueBehavior(priority_queue<vsearch<T> > &s, vsearch<T> n, bool reset, bool increment, bool silent){
+void IndexedBehavior<T>::enqueueBehavior(SearchQueueOf(T) &s, vsearch<T> n, bool reset, bool increment, bool silent){
     return;
 }
 
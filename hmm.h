@@ -1,17 +1,25 @@
+#ifndef _HMM_H_
+#define _HMM_H_
+
 #include "kseq.h"
 #include "qual.h"
 
 #include "tinyxml.h"
 #include "MersenneTwister.h"
+#include "parallel.h"
+#include "stats.h"
 
 #include <float.h>
 #include <math.h>
 #include <signal.h>
+#include <stdint.h>
 
+#include <algorithm>
 #include <list>
 #include <map>
 #include <queue>
 #include <set>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -23,32 +31,39 @@ typedef struct{
     double v;
 } logdouble;
 
-logdouble operator+(const logdouble lhs, const logdouble rhs){
+inline logdouble operator+(const logdouble lhs, const logdouble rhs){
     logdouble r;
     r.v = lhs.v + rhs.v;
     return r;
 }
 
-logdouble operator+(const logdouble lhs, const double rhs){
+inline logdouble operator+(const logdouble lhs, const double rhs){
     logdouble r;
     r.v = lhs.v + log(rhs);
     return r;
 }
 
-bool operator<(const logdouble lhs, const logdouble rhs){
+inline bool operator<(const logdouble lhs, const logdouble rhs){
     return lhs.v < rhs.v;
 }
 
+template <class T>
+class Behavior;
+
 template <class T>
 class vsearch_entry {
     //TODO add getters and setters to vsearch_entry
     public:
-        vsearch_entry<T>(){}
+        vsearch_entry<T>() : siblings(NULL), sibling(0) {}
         T state;
         vsearch_entry<T>* incoming;
         int position;
         int emission;
         logdouble loglikelihood;
+        // Behavior still holding unpushed, no more likely alternatives to
+        // this node, and this node's rank among them.
+        Behavior<T>* siblings;
+        int sibling;
          bool operator<(const vsearch_entry<T> n) const {
             return loglikelihood < n.loglikelihood;
         }
@@ -67,11 +82,164 @@ class vsearch {
         vsearch_entry<T> *_v;
 };
 
+#include "radixqueue.h"
+
+// DominanceQueue
+//   Wraps the frontier with the best log-likelihood known for every
+//   (state, emission, position) key. A candidate that doesn't beat the best
+//   is never allocated or pushed, and a key is closed once it has been
+//   popped, so older, worse entries still in the queue are discarded when
+//   they surface.
+typedef struct {
+    intptr_t state;
+    int emission;
+    int position;
+} dominance_key;
+
+typedef struct {
+    double best;
+    bool closed;
+} dominance_entry;
+
+struct dominance_hash {
+    size_t operator()(const dominance_key &k) const {
+        uint64_t h = (uint64_t) k.state * 0x9e3779b97f4a7c15ULL;
+        h ^= ((uint64_t) (uint32_t) k.emission << 32 | (uint32_t) k.position) * 0xc2b2ae3d27d4eb4fULL;
+        return (size_t) (h ^ (h >> 29));
+    }
+};
+
+struct dominance_equal {
+    bool operator()(const dominance_key &a, const dominance_key &b) const {
+        return a.state == b.state && a.emission == b.emission && a.position == b.position;
+    }
+};
+
+// A search hint: the read runs along state's positions on the diagonal
+// position = emission - offset, give or take width. A negative width shuts
+// the state out of the search.
+typedef struct {
+    int state;
+    int offset;
+    int width;
+} search_band;
+
+template <class T, class Q>
+class DominanceQueue : public Q {
+    public:
+        bool admit(T, int, int, logdouble);
+        bool close(T, int, int);
+        void band(T, int, int);
+    private:
+        static dominance_key key(T, int, int);
+        bool inBand(T, int, int) const;
+        std::unordered_map<dominance_key, dominance_entry, dominance_hash, dominance_equal> _best;
+        std::map<intptr_t, std::pair<int, int> > _bands; // state: (offset, width)
+};
+
+template <class T, class Q>
+dominance_key DominanceQueue<T, Q>::key(T state, int emission, int position){
+    dominance_key k;
+    k.state = (intptr_t) state;
+    k.emission = emission;
+    k.position = position;
+    return k;
+}
+
+// Confine state to a band around a diagonal (see search_band).
+template <class T, class Q>
+void DominanceQueue<T, Q>::band(T state, int offset, int width){
+    _bands[(intptr_t) state] = std::make_pair(offset, width);
+}
+
+template <class T, class Q>
+bool DominanceQueue<T, Q>::inBand(T state, int emission, int position) const {
+    std::map<intptr_t, std::pair<int, int> >::const_iterator b_itr = _bands.find((intptr_t) state);
+    if( b_itr == _bands.end() ){
+        return true;
+    }
+    int off = position - (emission - b_itr->second.first);
+    return off <= b_itr->second.second && -off <= b_itr->second.second;
+}
+
+// Should a node with this key and likelihood be pushed?
+template <class T, class Q>
+bool DominanceQueue<T, Q>::admit(T state, int emission, int position, logdouble ll){
+    if( !_bands.empty() && !inBand(state, emission, position) ){
+        return false;
+    }
+
+    dominance_entry e;
+    e.best = ll.v;
+    e.closed = false;
+
+    std::pair<typename std::unordered_map<dominance_key, dominance_entry, dominance_hash, dominance_equal>::iterator, bool> ins;
+    ins = _best.insert(std::make_pair(key(state, emission, position), e));
+    if( ins.second ){
+        return true;
+    }
+
+    dominance_entry &known = ins.first->second;
+    if( known.closed || ll.v <= known.best ){
+        return false;
+    }
+    known.best = ll.v;
+    return true;
+}
+
+// Mark a popped key as searched; false if it already was.
+template <class T, class Q>
+bool DominanceQueue<T, Q>::close(T state, int emission, int position){
+    dominance_entry e;
+    e.best = -DBL_MAX;
+    e.closed = true;
+
+    std::pair<typename std::unordered_map<dominance_key, dominance_entry, dominance_hash, dominance_equal>::iterator, bool> ins;
+    ins = _best.insert(std::make_pair(key(state, emission, position), e));
+    if( ins.second ){
+        return true;
+    }
+    if( ins.first->second.closed ){
+        return false;
+    }
+    ins.first->second.closed = true;
+    return true;
+}
+
 // No native templated typedefs.
+// The search frontier is a binary heap unless built with QUEUE=RADIX
+// (-DHMM_RADIX_QUEUE), which swaps in the monotone radix heap.
+#ifndef SearchBaseOf
+#ifdef HMM_RADIX_QUEUE
+#define SearchBaseOf(T) RadixQueue<T>
+#define SEARCH_QUEUE_NAME "radix"
+#else
+#define SearchBaseOf(T) std::priority_queue<vsearch<T> >
+#define SEARCH_QUEUE_NAME "heap"
+#endif
+#endif
+
+#ifndef SearchQueueOf
+#define SearchQueueOf(T) DominanceQueue<T, SearchBaseOf(T) >
+#endif
+
 #ifndef SearchQueue 
-#define SearchQueue std::priority_queue<vsearch<VState*> >
+#define SearchQueue SearchQueueOf(VState*)
 #endif
 
+// Counters from a single annotate() call.
+typedef struct {
+    bool found;       // did the search reach the end of the read?
+    bool fellBack;    // bands were given but didn't hold; run again without
+    int searched;     // nodes popped from the queue
+    int queueSize;    // queue size when the search finished
+    int peakQueue;    // largest queue size seen
+    int lastState;
+    int lastEmission;
+    int lastPosition;
+    double loglikelihood; // of the path found
+} search_stats;
+
 class HMM {
     public:
         HMM();
@@ -79,7 +247,12 @@ class HMM {
         HMM(const char*);
         HMM(char*);
         char* generate(int);
+        char* generate(int, MTRand&, std::vector<int>* path = NULL, std::vector<int>* diagonals = NULL);
+        std::vector<char*> generate(int, int, unsigned long, int = 1, unsigned long = 0);
+        static MTRand seedStream(unsigned long, unsigned long);
+        VState* getState(int id){ return _states[id]; }
         void viterbi(char*, char *qual =NULL);
+        std::list<std::string> annotate(const char*, const char *qual =NULL, search_stats* =NULL, const std::vector<search_band>* =NULL);
     private:
         void setTransitions();
         VState* _startState;
@@ -101,7 +274,8 @@ class Behavior {
         }
         static logdouble loglikelihood(bool, double=DBL_EPSILON, int=INT_MIN);
         virtual void relabelTransition(std::vector<T>&){ return; };
-        virtual void enqueueBehavior(std::priority_queue<vsearch<T> >&, vsearch<T>, bool=true, bool=false, bool=false) = 0;
+        virtual void enqueueBehavior(SearchQueueOf(T)&, vsearch<T>, bool=true, bool=false, bool=false) = 0;
+        virtual void enqueueSibling(SearchQueueOf(T)&, vsearch_entry<T>*){ return; }
 };
 
 // MonoBehavior
@@ -115,7 +289,7 @@ class MonoBehavior : public Behavior<T> {
         virtual T emit(double, int = 0);
         virtual logdouble loglikelihood(T, int=INT_MIN);
         void relabelTransition(std::vector<T>&);
-        void enqueueBehavior(std::priority_queue<vsearch<T> >&, vsearch<T>, bool=true,bool=false,bool=false);
+        void enqueueBehavior(SearchQueueOf(T)&, vsearch<T>, bool=true,bool=false,bool=false);
     private:
         T _emission;
         double _prob;
@@ -132,10 +306,15 @@ class PolyBehavior : public Behavior<T> {
         virtual T emit(double, int = 0);
         virtual logdouble loglikelihood(T, int=INT_MIN);
         void relabelTransition(std::vector<T>&);
-        void enqueueBehavior(std::priority_queue<vsearch<T> >&, vsearch<T>, bool=true, bool=false, bool=false);
+        void enqueueBehavior(SearchQueueOf(T)&, vsearch<T>, bool=true, bool=false, bool=false);
+        void enqueueSibling(SearchQueueOf(T)&, vsearch_entry<T>*);
    private:
+        void rank();
+        void enqueueRanked(SearchQueueOf(T)&, vsearch_entry<T>*, int, int, int);
         std::map<double, T> _emissions; 
         std::map<T, logdouble> _likelihoods;
+        // _likelihoods, most likely first
+        std::vector<std::pair<T, logdouble> > _ranked;
         double _density;
 };
 
@@ -149,7 +328,7 @@ class IndexedBehavior : public Behavior<T> {
         virtual T emit(double, int = 0);
         virtual logdouble loglikelihood(T, int, int=0);
         int size(){ return _emissions.size(); }
-        void enqueueBehavior(std::priority_queue<vsearch<T> >&, vsearch<T>, bool = false, bool = true, bool = false);
+        void enqueueBehavior(SearchQueueOf(T)&, vsearch<T>, bool = false, bool = true, bool = false);
     private:
         std::vector<T> _emissions;
         double _prob;
@@ -171,6 +350,7 @@ class VState {
         virtual logdouble transitionProbability(VState*,int = 0) = 0;
         virtual bool incrementing() = 0;
         virtual bool resetting() = 0;
+        virtual bool indexed(){ return false; }
     protected:
         virtual void relabelTransition(std::vector< VState* >&) = 0;
         int _id;
@@ -217,6 +397,7 @@ class IndexedState : public VState {
         logdouble transitionProbability(VState*, int = 0);
         bool incrementing(){ return true; }
         bool resetting(){ return false; }
+        bool indexed(){ return true; }
 
     private:
         IndexedBehavior<char> *_emissions;
@@ -243,3 +424,5 @@ class AcceptingState : public SilentState {
         bool hasTransition(){ return false; }
         void enqueueTransitions(SearchQueue&, vsearch_entry<VState*>* ){ return; }
 };
+
+#endif
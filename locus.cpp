@@ -0,0 +1,93 @@
+#include "locus.h"
+
+using namespace std;
+
+// LocusClassifier
+LocusClassifier::LocusClassifier(const SeedPattern &pattern, unsigned int minimum, double ratio){
+    _pattern = pattern;
+    _minimum = minimum;
+    _ratio = ratio;
+    assert( _pattern.valid() && !_pattern.sampled() );
+}
+
+// Add a locus by its germline alignment; returns its number.
+int LocusClassifier::insert(const string &name, MultipleSequenceAlign &msa){
+    int locus = _names.size();
+    _names.push_back(name);
+
+    HashSet hs = msa.makeHashes(_pattern);
+    set<Hash>::const_iterator h_itr;
+    for( h_itr = hs.getHashes().begin(); h_itr != hs.getHashes().end(); h_itr++ ){
+        _index.insert(h_itr->getMask(), h_itr->getValue(), h_itr->size(), _locusOf.size());
+        _locusOf.push_back(locus);
+    }
+    return locus;
+}
+
+// The read positions each locus's seeds hit, by locus.
+void LocusClassifier::score(const PackedSequence &read, vector<int> &scores){
+    scores.assign(_names.size(), 0);
+
+    _hits.clear();
+    _index.match(read, _hits);
+
+    _placed.clear();
+    vector<seed_hit>::iterator h_itr;
+    for( h_itr = _hits.begin(); h_itr != _hits.end(); h_itr++ ){
+        _placed.push_back(pair<int, int>(_locusOf[h_itr->id], h_itr->position));
+    }
+    sort(_placed.begin(), _placed.end());
+
+    for( unsigned int ii = 0; ii < _placed.size(); ii++ ){
+        if( ii == 0 || _placed[ii - 1] != _placed[ii] ){
+            scores[_placed[ii].first]++;
+        }
+    }
+}
+
+// Call the loci of seq[0, len), on whichever strand scores best. Nothing
+// is allocated once the buffers have grown to the longest read.
+void LocusClassifier::classify(const char *seq, size_t len, locus_call &call){
+    int codes[] = {A, T, C, G};
+
+    _packed.assign(seq, len, codes);
+    score(_packed, _scores[0]);
+
+    _reverse.resize(len);
+    if( len ){
+        nucleotideReverseComplement(seq, len, &_reverse[0]);
+    }
+    _packed.assign((len ? &_reverse[0] : seq), len, codes);
+    score(_packed, _scores[1]);
+
+    // the strand with the best single locus
+    int strand = 0;
+    int best[2] = {0, 0};
+    for( int s = 0; s < 2; s++ ){
+        for( unsigned int ii = 0; ii < _scores[s].size(); ii++ ){
+            best[s] = max(best[s], _scores[s][ii]);
+        }
+    }
+    if( best[1] > best[0] ){
+        strand = 1;
+    }
+    call.reverse = (strand == 1);
+
+    // the top loci, best first, the lower numbered of equals
+    vector<int> &scores = _scores[strand];
+    call.count = 0;
+    for( int c = 0; c < LOCUS_CANDIDATES; c++ ){
+        int top = -1;
+        for( int ii = 0; ii < (int) scores.size(); ii++ ){
+            if( find(call.locus, call.locus + call.count, ii) == call.locus + call.count && (top < 0 || scores[ii] > scores[top]) ){
+                top = ii;
+            }
+        }
+        if( top < 0 || scores[top] < (int) _minimum || (c > 0 && scores[top] < _ratio * call.hits[0]) ){
+            break;
+        }
+        call.locus[call.count] = top;
+        call.hits[call.count] = scores[top];
+        call.count++;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef _LOCUS_HMM_
+#define _LOCUS_HMM_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hasher.h"
+
+// LocusClassifier
+//   Picks the models worth decoding a read against before any Viterbi work.
+//   Each locus (heavy, kappa, lambda, ...) is given as its germline
+//   alignment and hashed as makeHashes does, under one seed pattern; all
+//   their seeds go into one SeedIndex, each tagged with its locus. A read is
+//   seeded on both strands and every locus scored by the read positions its
+//   seeds hit there. The best locus is called if it has at least `minimum`
+//   positions, and the runner-up alongside it if it has at least `ratio` of
+//   the best; a read no locus reaches `minimum` on is rejected.
+
+#define LOCUS_CANDIDATES 2
+#define LOCUS_MIN_HITS 12
+#define LOCUS_SECOND_RATIO 0.5
+#define LOCUS_SEED_PATTERN "111111111111:16"
+
+// The loci a read was assigned to, best first.
+typedef struct {
+    int count;                      // 0 for a rejected read
+    int locus[LOCUS_CANDIDATES];
+    int hits[LOCUS_CANDIDATES];     // read positions hit
+    bool reverse;                   // matched as its reverse complement
+} locus_call;
+
+class LocusClassifier {
+    public:
+        LocusClassifier(const SeedPattern& = SeedPattern(LOCUS_SEED_PATTERN), unsigned int = LOCUS_MIN_HITS, double = LOCUS_SECOND_RATIO);
+        int insert(const std::string&, MultipleSequenceAlign&);
+        void classify(const char*, size_t, locus_call&);
+        int size() const { return _names.size(); }
+        const std::string& getName(int ii) const { return _names[ii]; }
+    private:
+        void score(const PackedSequence&, std::vector<int>&);
+        SeedPattern _pattern;
+        std::vector<std::string> _names;
+        SeedIndex _index;
+        std::vector<int> _locusOf;      // by seed id
+        unsigned int _minimum;
+        double _ratio;
+        // kept between reads
+        PackedSequence _packed;
+        std::vector<char> _reverse;
+        std::vector<seed_hit> _hits;
+        std::vector< std::pair<int, int> > _placed;
+        std::vector<int> _scores[2];
+};
+
+#endif
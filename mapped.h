@@ -0,0 +1,209 @@
+#ifndef _MAPPED_H_
+#define _MAPPED_H_
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+// Mapped tables
+//   Lookup structures that are built once and then only read are kept as
+//   flat arrays of plain structs, so they can be written to a file as they
+//   are and mapped back read-only: no parsing at startup, and processes
+//   mapping the same file share its pages.
+//
+//   A file is a header followed by sections, each an array of one struct
+//   type starting on a 64-byte boundary (so that a section of cache line
+//   sized blocks keeps them whole), in native byte order.
+
+#define MAPPED_ALIGN 64
+
+typedef struct {
+    uint64_t offset; // from the start of the file
+    uint64_t count;  // elements
+} mapped_section;
+
+// FlatArray
+//   An array that either owns its elements or points into a mapped file;
+//   reading it is the same either way.
+template <class T>
+class FlatArray {
+    public:
+        FlatArray() : _data(NULL), _size(0) {}
+        FlatArray(const FlatArray &rhs){ copy(rhs); }
+        FlatArray& operator=(const FlatArray &rhs){ if( this != &rhs ){ copy(rhs); } return *this; }
+        void assign(const std::vector<T> &v){ _owned = v; own(); }
+        void swap(std::vector<T> &v){ _owned.swap(v); own(); }
+        void map(const T *data, size_t n){ _owned.clear(); _data = data; _size = n; }
+        void clear(){ _owned.clear(); own(); }
+        const T& operator[](size_t ii) const { return _data[ii]; }
+        const T* data() const { return _data; }
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+    private:
+        void own(){ _data = (_owned.empty() ? NULL : &_owned[0]); _size = _owned.size(); }
+        void copy(const FlatArray &rhs){
+            if( rhs._data && rhs._data == (rhs._owned.empty() ? NULL : &rhs._owned[0]) ){
+                assign(rhs._owned);
+            } else {
+                map(rhs._data, rhs._size);
+            }
+        }
+        std::vector<T> _owned;
+        const T *_data;
+        size_t _size;
+};
+
+// MappedFile
+//   A whole file mapped read-only. Whatever points into it shares the
+//   mapping through a shared_ptr, which unmaps it when the last goes.
+class MappedFile {
+    public:
+        MappedFile() : _data(NULL), _size(0) {}
+        ~MappedFile(){ if( _data ){ munmap(_data, _size); } }
+        bool open(const char*);
+        const char* data() const { return (const char*) _data; }
+        size_t size() const { return _size; }
+        template <class T> bool section(const mapped_section&, FlatArray<T>&) const;
+    private:
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+        void *_data;
+        size_t _size;
+};
+
+inline bool MappedFile::open(const char *fn){
+    int fd = ::open(fn, O_RDONLY);
+    if( fd < 0 ){
+        fprintf(stderr, "Could not open %s\n", fn);
+        return false;
+    }
+
+    struct stat st;
+    if( fstat(fd, &st) < 0 || st.st_size == 0 ){
+        fprintf(stderr, "Could not read %s\n", fn);
+        close(fd);
+        return false;
+    }
+
+    _size = st.st_size;
+    _data = mmap(NULL, _size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if( _data == MAP_FAILED ){
+        fprintf(stderr, "Could not map %s\n", fn);
+        _data = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Point a at a section, after checking it lies inside the file.
+template <class T>
+inline bool MappedFile::section(const mapped_section &s, FlatArray<T> &a) const {
+    if( s.offset % MAPPED_ALIGN || s.offset > _size || s.count > (_size - s.offset) / sizeof(T) ){
+        return false;
+    }
+    a.map((const T*) (data() + s.offset), s.count);
+    return true;
+}
+
+// MappedWriter
+//   Writes a file's sections after room for its header, then goes back and
+//   writes the header, which by then knows where they all are. It's all
+//   written to a new file beside the target, synced and renamed over it:
+//   a process that has the old file mapped keeps reading it whole, and
+//   the target is never seen half written.
+class MappedWriter {
+    public:
+        MappedWriter() : _fp(NULL), _offset(0) {}
+        ~MappedWriter(){ abandon(); }
+        bool open(const char*, size_t);
+        template <class T> bool write(const T*, size_t, mapped_section&);
+        template <class T> bool write(const FlatArray<T> &a, mapped_section &s){ return write(a.data(), a.size(), s); }
+        bool finish(const void*, size_t);
+    private:
+        bool pad();
+        void abandon();
+        FILE *_fp;
+        uint64_t _offset;
+        std::string _target;
+        std::string _temp;
+};
+
+inline bool MappedWriter::open(const char *fn, size_t header){
+    abandon();
+    _target = fn;
+    _temp = _target + ".XXXXXX";
+    int fd = mkstemp(&_temp[0]);
+    if( fd < 0 || !(_fp = fdopen(fd, "wb")) ){
+        fprintf(stderr, "Could not open %s for writing\n", _temp.c_str());
+        if( fd >= 0 ){
+            close(fd);
+            unlink(_temp.c_str());
+        }
+        _temp.clear();
+        return false;
+    }
+    // mkstemp's file is private to its owner
+    mode_t mask = umask(0);
+    umask(mask);
+    fchmod(fd, 0666 & ~mask);
+
+    _offset = header;
+    return fseek(_fp, header, SEEK_SET) == 0 && pad();
+}
+
+// Drop a file that wasn't finished.
+inline void MappedWriter::abandon(){
+    if( _fp ){
+        fclose(_fp);
+        _fp = NULL;
+    }
+    if( !_temp.empty() ){
+        unlink(_temp.c_str());
+        _temp.clear();
+    }
+}
+
+inline bool MappedWriter::pad(){
+    static const char zeros[MAPPED_ALIGN] = {0};
+    size_t n = (MAPPED_ALIGN - _offset % MAPPED_ALIGN) % MAPPED_ALIGN;
+    _offset += n;
+    return fwrite(zeros, 1, n, _fp) == n;
+}
+
+template <class T>
+inline bool MappedWriter::write(const T *data, size_t n, mapped_section &s){
+    s.offset = _offset;
+    s.count = n;
+    if( n && fwrite(data, sizeof(T), n, _fp) != n ){
+        return false;
+    }
+    _offset += n * sizeof(T);
+    return pad();
+}
+
+inline bool MappedWriter::finish(const void *header, size_t size){
+    bool ok = fseek(_fp, 0, SEEK_SET) == 0 && fwrite(header, 1, size, _fp) == size &&
+        fflush(_fp) == 0 && fsync(fileno(_fp)) == 0;
+    ok = (fclose(_fp) == 0) && ok;
+    _fp = NULL;
+    ok = ok && rename(_temp.c_str(), _target.c_str()) == 0;
+    if( ok ){
+        _temp.clear();
+    } else {
+        abandon();
+    }
+    return ok;
+}
+
+#endif
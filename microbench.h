@@ -0,0 +1,203 @@
+#ifndef _MICROBENCH_HMM_
+#define _MICROBENCH_HMM_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MersenneTwister.h"
+
+// Shared pieces of the seeding-layer microbenchmarks.
+//
+// The inputs are synthetic germline multiple sequence alignments shaped like
+// the IGHV set in data.ss: ~60 alleles of ~300 columns descended from a common
+// ancestor, with conserved framework-like columns, a minority of variable
+// columns and the odd indel column. `scale` multiplies the number of alleles.
+
+#define MICROBENCH_ALLELES 62
+#define MICROBENCH_COLUMNS 300
+#define MICROBENCH_MIN_SECONDS 0.2
+#define MICROBENCH_ALLOCATION_ROUNDS 100
+
+// Heap allocations so far, counted by the replacement operators new below.
+// Each benchmark is a single translation unit including this, so the
+// replacements are defined once per program. Every form is replaced, the
+// array, sized and nothrow ones included, so whatever allocates is counted
+// and whatever frees goes back to the same heap. They're kept out of line so
+// the compiler doesn't pair an inlined new with an inlined free and flag
+// the two as mismatched.
+static long microbenchAllocations = 0;
+
+__attribute__((noinline)) inline void* microbenchAllocate(size_t n){
+    microbenchAllocations++;
+    void *p = malloc(n ? n : 1);
+    if( !p ){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) inline void microbenchFree(void *p){
+    free(p);
+}
+
+void* operator new(size_t n){ return microbenchAllocate(n); }
+void* operator new[](size_t n){ return microbenchAllocate(n); }
+void operator delete(void *p) noexcept { microbenchFree(p); }
+void operator delete[](void *p) noexcept { microbenchFree(p); }
+void operator delete(void *p, size_t) noexcept { microbenchFree(p); }
+void operator delete[](void *p, size_t) noexcept { microbenchFree(p); }
+
+// the nothrow forms; std::stable_sort gets its buffer from these
+void* operator new(size_t n, const std::nothrow_t&) noexcept {
+    microbenchAllocations++;
+    return malloc(n ? n : 1);
+}
+void* operator new[](size_t n, const std::nothrow_t&) noexcept {
+    microbenchAllocations++;
+    return malloc(n ? n : 1);
+}
+void operator delete(void *p, const std::nothrow_t&) noexcept { microbenchFree(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept { microbenchFree(p); }
+
+typedef std::pair<std::string, std::string> fasta_record;
+
+inline double microbenchNow(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+inline char randomBase(MTRand &rng){
+    return "ACGT"[rng.randInt(3)];
+}
+
+// An aligned set of `rows` alleles of `columns` columns.
+inline std::vector<fasta_record> syntheticMSA(MTRand &rng, int rows, int columns, double variable = 0.3, double divergence = 0.2, double indels = 0.02){
+
+    std::string ancestor;
+    std::vector<bool> variableColumn(columns, false);
+    std::vector<bool> indelColumn(columns, false);
+    for( int ii = 0; ii < columns; ii++ ){
+        ancestor.push_back(randomBase(rng));
+        variableColumn[ii] = rng.randExc() < variable;
+        indelColumn[ii] = rng.randExc() < indels;
+    }
+
+    std::vector<fasta_record> msa;
+    char name[64];
+    for( int rr = 0; rr < rows; rr++ ){
+        std::string seq = ancestor;
+        for( int ii = 0; ii < columns; ii++ ){
+            if( indelColumn[ii] && rng.randExc() < 0.3 ){
+                seq[ii] = '-';
+            } else if( variableColumn[ii] && rng.randExc() < divergence ){
+                seq[ii] = randomBase(rng);
+            }
+        }
+        snprintf(name, sizeof(name), "IGHVsyn-%d*01", rr);
+        msa.push_back(fasta_record(std::string(name), seq));
+    }
+    return msa;
+}
+
+// Reads drawn from random alleles: gaps removed, lightly mutated.
+inline std::vector<std::string> syntheticReads(MTRand &rng, const std::vector<fasta_record> &msa, int count, double mutation = 0.02){
+    std::vector<std::string> reads;
+    for( int ii = 0; ii < count; ii++ ){
+        const std::string &allele = msa[rng.randInt(msa.size() - 1)].second;
+        std::string read;
+        for( unsigned int jj = 0; jj < allele.size(); jj++ ){
+            if( allele[jj] == '-' ){
+                continue;
+            }
+            read.push_back(rng.randExc() < mutation ? randomBase(rng) : allele[jj]);
+        }
+        reads.push_back(read);
+    }
+    return reads;
+}
+
+// Write the alignment to a temporary FASTA file so it can be read back
+// through kseq exactly as a real database would be.
+inline std::string writeFasta(const std::vector<fasta_record> &msa){
+    char fn[] = "/tmp/microbenchXXXXXX";
+    int fd = mkstemp(fn);
+    FILE *fp = fdopen(fd, "w");
+    for( unsigned int ii = 0; ii < msa.size(); ii++ ){
+        fprintf(fp, ">%s\n%s\n", msa[ii].first.c_str(), msa[ii].second.c_str());
+    }
+    fclose(fp);
+    return std::string(fn);
+}
+
+// One JSON line per measurement.
+inline void microbenchReport(const char *name, int scale, long ops, double seconds, const char *unit = "op"){
+    printf("{\"benchmark\": \"%s\", \"scale\": %d, \"ops\": %ld, \"seconds\": %.6f, \"ns_per_%s\": %.1f}\n",
+           name, scale, ops, seconds, unit, seconds * 1e9 / ops);
+    fflush(stdout);
+}
+
+// How the seed filters did over the probes counted: the fraction turned
+// away, and of the probes for keys not there, the fraction let through.
+inline void microbenchProbes(const char *name, int scale, long probes, long passed, long found){
+    printf("{\"benchmark\": \"%s\", \"scale\": %d, \"probes\": %ld, \"rejected\": %.4f, \"false_positive_rate\": %.5f}\n",
+           name, scale, probes, (probes ? (double) (probes - passed) / probes : 0.0),
+           (probes > found ? (double) (passed - found) / (probes - found) : 0.0));
+    fflush(stdout);
+}
+
+// Run `body` (which performs `per` operations) until MICROBENCH_MIN_SECONDS
+// have passed and report the per-operation cost.
+#define MICROBENCH(name, scale, per, body) do {              \
+        long _ops = 0;                                       \
+        double _start = microbenchNow();                     \
+        double _elapsed = 0.0;                               \
+        do {                                                 \
+            body;                                            \
+            _ops += (per);                                   \
+            _elapsed = microbenchNow() - _start;             \
+        } while( _elapsed < MICROBENCH_MIN_SECONDS );        \
+        microbenchReport(name, scale, _ops, _elapsed);       \
+    } while(0)
+
+// Run `body` (which performs `per` operations) once to warm up, then
+// MICROBENCH_ALLOCATION_ROUNDS times, and report the heap allocations made
+// per operation. Only paths meant to be allocation-free are measured this
+// way, so any allocation at all fails the run.
+#define MICROBENCH_ALLOCATIONS(name, scale, per, body) do {                     \
+        body;                                                                   \
+        long _before = microbenchAllocations;                                   \
+        for( int _round = 0; _round < MICROBENCH_ALLOCATION_ROUNDS; _round++ ){ \
+            body;                                                               \
+        }                                                                       \
+        long _ops = (long) (per) * MICROBENCH_ALLOCATION_ROUNDS;                \
+        long _allocations = microbenchAllocations - _before;                    \
+        printf("{\"benchmark\": \"%s\", \"scale\": %d, \"ops\": %ld, \"allocations_per_op\": %.3f}\n", \
+               name, scale, _ops, (double) _allocations / _ops);                \
+        fflush(stdout);                                                         \
+        if( _allocations ){                                                     \
+            fprintf(stderr, "%s allocated %ld times; it's meant not to\n", name, _allocations); \
+            exit(1);                                                            \
+        }                                                                       \
+    } while(0)
+
+inline std::vector<int> microbenchScales(int argc, char *argv[]){
+    std::vector<int> scales;
+    for( int ii = 1; ii < argc; ii++ ){
+        scales.push_back(atoi(argv[ii]));
+    }
+    if( scales.empty() ){
+        int defaults[] = {1, 2, 5, 10};
+        scales = std::vector<int>(defaults, defaults + 4);
+    }
+    return scales;
+}
+
+#endif
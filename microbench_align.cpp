@@ -0,0 +1,328 @@
+#include "hashAlign.h"
+#include "microbench.h"
+
+using namespace boost;
+using namespace std;
+
+// Microbenchmarks for the hashAlign seeding primitives.
+//   Usage: microbench_align [scale ...]   (default scales 1 2 5 10)
+
+static volatile unsigned long sink = 0;
+
+static bool sameHits(const vector<reference_hit> &lhs, const vector<reference_hit> &rhs){
+    if( lhs.size() != rhs.size() ){
+        return false;
+    }
+    for( unsigned int ii = 0; ii < lhs.size(); ii++ ){
+        if( lhs[ii].reference != rhs[ii].reference || lhs[ii].offset != rhs[ii].offset || lhs[ii].hits != rhs[ii].hits ){
+            return false;
+        }
+    }
+    return true;
+}
+
+// A copy of the set and the set saved and loaded back have to match every
+// read exactly as the set does; the run fails if they don't.
+static void checkCopies(const char *name, int scale, ReferenceSet &refs, vector<Sequence> &reads){
+    char fn[] = "/tmp/microbenchXXXXXX";
+    int fd = mkstemp(fn);
+    if( fd < 0 ){
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+
+    ReferenceSet copied = refs;
+    ReferenceSet loaded;
+    bool ok = refs.save(fn) && loaded.load(fn);
+    unlink(fn);
+
+    long mismatches = 0;
+    for( unsigned int ii = 0; ok && ii < reads.size(); ii++ ){
+        vector<reference_hit> hits = refs.match(reads[ii]);
+        mismatches += !sameHits(hits, copied.match(reads[ii])) + !sameHits(hits, loaded.match(reads[ii]));
+    }
+
+    printf("{\"check\": \"%s copied and loaded\", \"scale\": %d, \"reads\": %ld, \"mismatches\": %ld}\n",
+           name, scale, (long) reads.size(), (ok ? mismatches : -1L));
+    fflush(stdout);
+    if( !ok || mismatches ){
+        exit(1);
+    }
+}
+
+// How often sampling keeps the candidate probing every offset ranks first:
+// reads whose best (reference, offset) is still a candidate, and among the
+// best supported ones. Only reported; sampling is allowed to lose some.
+static void checkBest(int scale, ReferenceSet &sampled, ReferenceSet &every, vector<Sequence> &reads){
+    long kept = 0, best = 0;
+    for( unsigned int ii = 0; ii < reads.size(); ii++ ){
+        vector<reference_hit> truth = every.match(reads[ii]), hits = sampled.match(reads[ii]);
+        for( unsigned int jj = 0; !truth.empty() && jj < hits.size(); jj++ ){
+            if( hits[jj].reference == truth[0].reference && hits[jj].offset == truth[0].offset ){
+                kept++;
+                best += hits[jj].hits == hits[0].hits;
+                break;
+            }
+        }
+    }
+    printf("{\"check\": \"ReferenceSet sampled best\", \"scale\": %d, \"reads\": %ld, \"kept\": %ld, \"best\": %ld}\n",
+           scale, (long) reads.size(), kept, best);
+    fflush(stdout);
+}
+
+static void benchScale(int scale){
+
+    MTRand rng((MTRand::uint32) scale);
+    vector<fasta_record> records = syntheticMSA(rng, MICROBENCH_ALLELES * scale, MICROBENCH_COLUMNS);
+    vector<string> reads = syntheticReads(rng, records, 100);
+    string fn = writeFasta(records);
+
+    MultipleSequenceAlgn m;
+    MultipleSequenceAlgn uncounted; // never asked for an encoding
+    vector<Sequence> rows;
+
+    gzFile fp = gzopen(fn.c_str(), "r");
+    kseq_t *seq = kseq_init(fp);
+    while( kseq_read(seq) >= 0 ){
+        m.insert(seq);
+        uncounted.insert(seq);
+        rows.push_back(Sequence(seq));
+    }
+    kseq_destroy(seq);
+    gzclose(fp);
+    unlink(fn.c_str());
+
+    vector<int> encoding = m.getMinimalEncoding();
+
+    MICROBENCH("Sequence::encode", scale, rows.size(), {
+        for( unsigned int ii = 0; ii < rows.size(); ii++ ){
+            sink += rows[ii].encode(encoding).size();
+        }
+    });
+
+    // Sequence::pack keeps its result, so this packs afresh.
+    MICROBENCH("PackedSequence", scale, rows.size(), {
+        for( unsigned int ii = 0; ii < rows.size(); ii++ ){
+            sink += PackedSequence(rows[ii].getSeq(), &encoding[0]).size();
+        }
+    });
+
+    // The kernels behind them, scalar and as dispatched, over the rows.
+    vector<uint64_t> packedBits(MICROBENCH_COLUMNS / 16 + 2), packedMask(packedBits.size());
+    string stripped(MICROBENCH_COLUMNS + 16, ' ');
+
+    MICROBENCH("nucleotidePack (scalar)", scale, rows.size(), {
+        for( unsigned int ii = 0; ii < rows.size(); ii++ ){
+            const string &row = rows[ii].getSeq();
+            nucleotidePackScalar(row.data(), row.size(), &encoding[0], &packedBits[0], &packedMask[0]);
+            sink += packedBits[0];
+        }
+    });
+
+    MICROBENCH("nucleotidePack", scale, rows.size(), {
+        for( unsigned int ii = 0; ii < rows.size(); ii++ ){
+            const string &row = rows[ii].getSeq();
+            nucleotidePack(row.data(), row.size(), &encoding[0], &packedBits[0], &packedMask[0]);
+            sink += packedBits[0];
+        }
+    });
+
+    MICROBENCH("nucleotideStrip (scalar)", scale, rows.size(), {
+        for( unsigned int ii = 0; ii < rows.size(); ii++ ){
+            const string &row = rows[ii].getSeq();
+            sink += nucleotideStripScalar(row.data(), NULL, row.size(), &stripped[0], NULL);
+        }
+    });
+
+    MICROBENCH("nucleotideStrip", scale, rows.size(), {
+        for( unsigned int ii = 0; ii < rows.size(); ii++ ){
+            const string &row = rows[ii].getSeq();
+            sink += nucleotideStrip(row.data(), NULL, row.size(), &stripped[0], NULL);
+        }
+    });
+
+    MICROBENCH("nucleotideReverseComplement (scalar)", scale, rows.size(), {
+        for( unsigned int ii = 0; ii < rows.size(); ii++ ){
+            const string &row = rows[ii].getSeq();
+            nucleotideReverseComplementScalar(row.data(), row.size(), &stripped[0]);
+            sink += stripped[0];
+        }
+    });
+
+    MICROBENCH("nucleotideReverseComplement", scale, rows.size(), {
+        for( unsigned int ii = 0; ii < rows.size(); ii++ ){
+            const string &row = rows[ii].getSeq();
+            nucleotideReverseComplement(row.data(), row.size(), &stripped[0]);
+            sink += stripped[0];
+        }
+    });
+
+    MICROBENCH("Sequence::ungapped", scale, rows.size(), {
+        for( unsigned int ii = 0; ii < rows.size(); ii++ ){
+            sink += rows[ii].ungapped().getMask().size();
+        }
+    });
+
+    MICROBENCH("MultipleSequenceAlgn::getMinimalEncoding", scale, 1, {
+        sink += m.getMinimalEncoding()[0];
+    });
+
+    // Column counts are kept between calls; these start from a copy without
+    // them, so they include counting (and the copy).
+    MICROBENCH("MultipleSequenceAlgn::getMinimalEncoding (uncounted)", scale, 1, {
+        MultipleSequenceAlgn fresh = uncounted;
+        sink += fresh.getMinimalEncoding()[0];
+    });
+
+    MICROBENCH("MultipleSequenceAlgn::getMinimalEncoding (uncounted, 4 threads)", scale, 1, {
+        MultipleSequenceAlgn fresh = uncounted;
+        sink += fresh.getMinimalEncoding(4)[0];
+    });
+
+    list<Hash> hashes;
+    MICROBENCH("makeHashes", scale, 1, {
+        hashes = m.makeHashes(encoding);
+        sink += hashes.size();
+    });
+
+    if( hashes.empty() ){
+        fprintf(stderr, "scale %d: no hashes, skipping match benchmarks\n", scale);
+        return;
+    }
+
+    // Windows of hash width taken from a read, at every bit offset.
+    Sequence read(reads[0]);
+    PackedSequence encoded = read.pack(encoding);
+    unsigned int width = hashes.front().size();
+    vector<uint64_t> windows;
+    for( unsigned int ii = 0; ii + width <= encoded.bits(); ii++ ){
+        windows.push_back(encoded.window(ii, width));
+    }
+
+    MICROBENCH("Hash::match", scale, hashes.size() * windows.size(), {
+        list<Hash>::iterator h_itr;
+        for( h_itr = hashes.begin(); h_itr != hashes.end(); h_itr++ ){
+            for( unsigned int ii = 0; ii < windows.size(); ii++ ){
+                sink += h_itr->match(windows[ii]);
+            }
+        }
+    });
+
+    MICROBENCH("Hash::matches", scale, hashes.size(), {
+        list<Hash>::iterator h_itr;
+        for( h_itr = hashes.begin(); h_itr != hashes.end(); h_itr++ ){
+            sink += h_itr->matches(read).size();
+        }
+    });
+
+    MICROBENCH("MultipleSequenceAlgn::getReferences", scale, 1, {
+        sink += m.getReferences().size();
+    });
+
+    MICROBENCH("Reference", scale, rows.size(), {
+        for( unsigned int ii = 0; ii < rows.size(); ii++ ){
+            sink += Reference(rows[ii], hashes, encoding).getPositions().size();
+        }
+    });
+
+    ReferenceSet refs = m.getReferences();
+    vector<Sequence> readSeqs;
+    for( unsigned int ii = 0; ii < reads.size(); ii++ ){
+        readSeqs.push_back(Sequence(reads[ii]));
+    }
+
+    // Seeding alone, into a buffer kept between reads.
+    vector<seed_hit> hits;
+    MICROBENCH("ReferenceSet::seed", scale, readSeqs.size(), {
+        for( unsigned int ii = 0; ii < readSeqs.size(); ii++ ){
+            hits.clear();
+            refs.seed(readSeqs[ii], hits);
+            sink += hits.size();
+        }
+    });
+
+    MICROBENCH_ALLOCATIONS("ReferenceSet::seed", scale, readSeqs.size(), {
+        for( unsigned int ii = 0; ii < readSeqs.size(); ii++ ){
+            hits.clear();
+            refs.seed(readSeqs[ii], hits);
+            sink += hits.size();
+        }
+    });
+
+    checkCopies("ReferenceSet", scale, refs, readSeqs);
+    ReferenceSet spaced = m.getReferences(SeedPattern("1101101101101:6"));
+    checkCopies("ReferenceSet (spaced)", scale, spaced, readSeqs);
+
+    const seed_probe_counts &probes = refs.probeCounts();
+    microbenchProbes("ReferenceSet::seed filter", scale, probes.probes, probes.passed, probes.found);
+
+    // The same seeds, probed at every offset of the read.
+    ReferenceSet every = m.getReferences(SeedPattern(DEFAULT_SEED_SHAPE));
+    MICROBENCH("ReferenceSet::seed (every offset)", scale, readSeqs.size(), {
+        for( unsigned int ii = 0; ii < readSeqs.size(); ii++ ){
+            hits.clear();
+            every.seed(readSeqs[ii], hits);
+            sink += hits.size();
+        }
+    });
+
+    checkCopies("ReferenceSet (every offset)", scale, every, readSeqs);
+
+    const seed_probe_counts &everyProbes = every.probeCounts();
+    microbenchProbes("ReferenceSet::seed filter (every offset)", scale, everyProbes.probes, everyProbes.passed, everyProbes.found);
+    checkBest(scale, refs, every, readSeqs);
+
+    // Looking hashes up in an ordered set compares them in place.
+    set<Hash> hashSet(hashes.begin(), hashes.end());
+    MICROBENCH_ALLOCATIONS("set<Hash>::find", scale, hashes.size(), {
+        list<Hash>::iterator h_itr;
+        for( h_itr = hashes.begin(); h_itr != hashes.end(); h_itr++ ){
+            sink += (hashSet.find(*h_itr) != hashSet.end());
+        }
+    });
+
+    MICROBENCH("ReferenceSet::match", scale, readSeqs.size(), {
+        for( unsigned int ii = 0; ii < readSeqs.size(); ii++ ){
+            sink += refs.match(readSeqs[ii]).size();
+        }
+    });
+
+    // Into a buffer kept between reads, as an annotation run would.
+    vector<reference_hit> candidates;
+    MICROBENCH("ReferenceSet::match (buffer)", scale, readSeqs.size(), {
+        for( unsigned int ii = 0; ii < readSeqs.size(); ii++ ){
+            refs.match(readSeqs[ii], candidates);
+            sink += candidates.size();
+        }
+    });
+
+    MICROBENCH_ALLOCATIONS("ReferenceSet::match (buffer)", scale, readSeqs.size(), {
+        for( unsigned int ii = 0; ii < readSeqs.size(); ii++ ){
+            refs.match(readSeqs[ii], candidates);
+            sink += candidates.size();
+        }
+    });
+
+    MICROBENCH("ReferenceSet::match (buffer, every offset)", scale, readSeqs.size(), {
+        for( unsigned int ii = 0; ii < readSeqs.size(); ii++ ){
+            every.match(readSeqs[ii], candidates);
+            sink += candidates.size();
+        }
+    });
+
+    MICROBENCH("ReferenceSet::chain", scale, readSeqs.size(), {
+        for( unsigned int ii = 0; ii < readSeqs.size(); ii++ ){
+            sink += refs.chain(readSeqs[ii]).size();
+        }
+    });
+}
+
+int main(int argc, char *argv[]){
+
+    vector<int> scales = microbenchScales(argc, argv);
+    for( unsigned int ii = 0; ii < scales.size(); ii++ ){
+        benchScale(scales[ii]);
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "hasher.h"
+#include "locus.h"
+#include "microbench.h"
+
+using namespace boost;
+using namespace std;
+
+// Microbenchmarks for the hasher seeding primitives.
+//   Usage: microbench_hasher [scale ...]   (default scales 1 2 5 10)
+
+static volatile unsigned long sink = 0;
+
+static vector<Sequence> readFasta(const string &fn, MultipleSequenceAlign *m = NULL){
+    vector<Sequence> res;
+    gzFile fp = gzopen(fn.c_str(), "r");
+    kseq_t *seq = kseq_init(fp);
+    while( kseq_read(seq) >= 0 ){
+        if( m ){
+            m->insert(seq);
+        }
+        res.push_back(Sequence(seq));
+    }
+    kseq_destroy(seq);
+    gzclose(fp);
+    unlink(fn.c_str());
+    return res;
+}
+
+static void benchScale(int scale){
+
+    MTRand rng((MTRand::uint32) scale);
+    vector<fasta_record> records = syntheticMSA(rng, MICROBENCH_ALLELES * scale, MICROBENCH_COLUMNS);
+    vector<string> readSeqs = syntheticReads(rng, records, 10);
+
+    vector<fasta_record> readRecords;
+    for( unsigned int ii = 0; ii < readSeqs.size(); ii++ ){
+        readRecords.push_back(fasta_record("read", readSeqs[ii]));
+    }
+
+    MultipleSequenceAlign m;
+    readFasta(writeFasta(records), &m);
+    vector<Sequence> reads = readFasta(writeFasta(readRecords));
+
+    HashSet hs;
+    MICROBENCH("makeHashes", scale, 1, {
+        hs = m.makeHashes();
+        sink += hs.size();
+    });
+
+    MICROBENCH("HashSet::matchAll", scale, reads.size(), {
+        for( unsigned int ii = 0; ii < reads.size(); ii++ ){
+            sink += hs.matchAll(reads[ii]).size();
+        }
+    });
+
+    // The hot path: hits appended to a buffer that's kept between reads.
+    vector<seed_hit> hits;
+    MICROBENCH("HashSet::match", scale, reads.size(), {
+        for( unsigned int ii = 0; ii < reads.size(); ii++ ){
+            hits.clear();
+            hs.match(reads[ii].getPacked(), hits);
+            sink += hits.size();
+        }
+    });
+
+    MICROBENCH_ALLOCATIONS("HashSet::match", scale, reads.size(), {
+        for( unsigned int ii = 0; ii < reads.size(); ii++ ){
+            hits.clear();
+            hs.match(reads[ii].getPacked(), hits);
+            sink += hits.size();
+        }
+    });
+
+    const seed_probe_counts &probes = hs.probeCounts();
+    microbenchProbes("HashSet::match filter", scale, probes.probes, probes.passed, probes.found);
+
+    // Routing a read among three loci: its own and two unrelated ones.
+    LocusClassifier classifier;
+    classifier.insert("own", m);
+    for( int ii = 0; ii < 2; ii++ ){
+        MultipleSequenceAlign other;
+        readFasta(writeFasta(syntheticMSA(rng, MICROBENCH_ALLELES * scale, MICROBENCH_COLUMNS)), &other);
+        classifier.insert("other", other);
+    }
+
+    locus_call call;
+    MICROBENCH("LocusClassifier::classify", scale, reads.size(), {
+        for( unsigned int ii = 0; ii < reads.size(); ii++ ){
+            classifier.classify(reads[ii].getSeq().data(), reads[ii].getSeq().size(), call);
+            sink += call.count;
+        }
+    });
+
+    MICROBENCH_ALLOCATIONS("LocusClassifier::classify", scale, reads.size(), {
+        for( unsigned int ii = 0; ii < reads.size(); ii++ ){
+            classifier.classify(reads[ii].getSeq().data(), reads[ii].getSeq().size(), call);
+            sink += call.count;
+        }
+    });
+}
+
+int main(int argc, char *argv[]){
+
+    vector<int> scales = microbenchScales(argc, argv);
+    for( unsigned int ii = 0; ii < scales.size(); ii++ ){
+        benchScale(scales[ii]);
+    }
+    return 0;
+}
@@ -0,0 +1,247 @@
+#ifndef _NUCLEOTIDE_H_
+#define _NUCLEOTIDE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NUCLEOTIDE_SSSE3
+#include <tmmintrin.h>
+#endif
+
+// Nucleotide kernels
+//   The per-base work every read goes through before seeding: packing to
+//   two bits per base with the N/gap mask, stripping gaps and reverse
+//   complementing. Each kernel has a scalar version and, on x86, an SSSE3
+//   version that takes 16 bases a step; the plain names pick the SSSE3
+//   version at run time when the CPU has it.
+//
+//   A, C, G and T are recognised in either case; anything else (gaps, Ns,
+//   IUPAC codes) is not a nucleotide.
+
+// Base index of every character: 0-3 for A, T, C, G, 4 for anything else.
+inline const unsigned char* nucleotideIndex(){
+    static const struct table {
+        unsigned char index[256];
+        table(){
+            memset(index, 4, sizeof(index));
+            const char *upper = "ATCG";
+            const char *lower = "atcg";
+            for( int ii = 0; ii < 4; ii++ ){
+                index[(unsigned char) upper[ii]] = index[(unsigned char) lower[ii]] = ii;
+            }
+        }
+    } t;
+    return t.index;
+}
+
+inline bool isNucleotideChar(char c){
+    return nucleotideIndex()[(unsigned char) c] < 4;
+}
+
+inline bool nucleotideSimd(){
+#ifdef NUCLEOTIDE_SSSE3
+    static const bool ssse3 = (__builtin_cpu_init(), __builtin_cpu_supports("ssse3"));
+    return ssse3;
+#else
+    return false;
+#endif
+}
+
+// Pack
+//   Base i of seq goes to bits 2i and 2i + 1 of bits, coded by codes[] (A,
+//   T, C, G, in that order); anything else is coded as an A and masked. mask
+//   gets 11 under nucleotides and 00 elsewhere. Both take (2 * len + 63) / 64
+//   words.
+inline void nucleotidePackScalar(const char *seq, size_t len, const int *codes, uint64_t *bits, uint64_t *mask){
+
+    const unsigned char *index = nucleotideIndex();
+    unsigned char code[5];
+    for( int ii = 0; ii < 4; ii++ ){
+        code[ii] = codes[ii];
+    }
+    code[4] = codes[0];
+
+    size_t words = (2 * len + 63) / 64;
+    for( size_t w = 0; w < words; w++ ){
+        uint64_t b = 0;
+        uint64_t m = 0;
+        size_t end = (32 * (w + 1) < len ? 32 * (w + 1) : len);
+        for( size_t ii = 32 * w; ii < end; ii++ ){
+            unsigned char n = index[(unsigned char) seq[ii]];
+            b |= (uint64_t) code[n] << (2 * (ii & 31));
+            m |= (uint64_t) (n < 4 ? 3 : 0) << (2 * (ii & 31));
+        }
+        bits[w] = b;
+        mask[w] = m;
+    }
+}
+
+#ifdef NUCLEOTIDE_SSSE3
+// 0xff under the bytes of v that are nucleotides.
+__attribute__((target("ssse3")))
+inline __m128i nucleotideBytes(__m128i v){
+    __m128i f = _mm_or_si128(v, _mm_set1_epi8(0x20)); // fold to lower case
+    __m128i n = _mm_cmpeq_epi8(f, _mm_set1_epi8('a'));
+    n = _mm_or_si128(n, _mm_cmpeq_epi8(f, _mm_set1_epi8('c')));
+    n = _mm_or_si128(n, _mm_cmpeq_epi8(f, _mm_set1_epi8('g')));
+    return _mm_or_si128(n, _mm_cmpeq_epi8(f, _mm_set1_epi8('t')));
+}
+
+// Sixteen 2-bit values, one to a byte, as 32 bits.
+__attribute__((target("ssse3")))
+inline uint32_t nucleotideGather(__m128i v){
+    v = _mm_maddubs_epi16(v, _mm_set1_epi16(0x0401));  // b0 | b1 << 2
+    v = _mm_madd_epi16(v, _mm_set1_epi32(0x00100001)); // w0 | w1 << 4
+    v = _mm_shuffle_epi8(v, _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+    return (uint32_t) _mm_cvtsi128_si32(v);
+}
+
+__attribute__((target("ssse3")))
+inline void nucleotidePackSsse3(const char *seq, size_t len, const int *codes, uint64_t *bits, uint64_t *mask){
+
+    // A, C, G and T differ in their low nibbles (1, 3, 7, 4), in either case
+    char table[16];
+    memset(table, codes[0], sizeof(table));
+    table[1] = codes[0];
+    table[4] = codes[1];
+    table[3] = codes[2];
+    table[7] = codes[3];
+    __m128i lookup = _mm_loadu_si128((const __m128i*) table);
+    __m128i other  = _mm_set1_epi8(codes[0]);
+    __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i three  = _mm_set1_epi8(3);
+
+    size_t full = len / 32;
+    for( size_t w = 0; w < full; w++ ){
+        uint64_t b = 0, m = 0;
+        for( int half = 0; half < 2; half++ ){
+            __m128i v = _mm_loadu_si128((const __m128i*) (seq + 32 * w + 16 * half));
+            __m128i n = nucleotideBytes(v);
+            __m128i c = _mm_shuffle_epi8(lookup, _mm_and_si128(v, nibble));
+            c = _mm_or_si128(_mm_and_si128(n, c), _mm_andnot_si128(n, other));
+            b |= (uint64_t) nucleotideGather(c) << (32 * half);
+            m |= (uint64_t) nucleotideGather(_mm_and_si128(n, three)) << (32 * half);
+        }
+        bits[w] = b;
+        mask[w] = m;
+    }
+
+    if( 32 * full < len ){
+        nucleotidePackScalar(seq + 32 * full, len - 32 * full, codes, bits + full, mask + full);
+    }
+}
+#endif
+
+inline void nucleotidePack(const char *seq, size_t len, const int *codes, uint64_t *bits, uint64_t *mask){
+#ifdef NUCLEOTIDE_SSSE3
+    if( nucleotideSimd() ){
+        nucleotidePackSsse3(seq, len, codes, bits, mask);
+        return;
+    }
+#endif
+    nucleotidePackScalar(seq, len, codes, bits, mask);
+}
+
+// Strip
+//   Copy the nucleotides of seq to out, and if qual is given the qualities
+//   that go with them to qualOut; returns how many there were.
+inline size_t nucleotideStripScalar(const char *seq, const char *qual, size_t len, char *out, char *qualOut){
+    const unsigned char *index = nucleotideIndex();
+    size_t n = 0;
+    for( size_t ii = 0; ii < len; ii++ ){
+        out[n] = seq[ii];
+        if( qual ){
+            qualOut[n] = qual[ii];
+        }
+        n += (index[(unsigned char) seq[ii]] < 4);
+    }
+    return n;
+}
+
+#ifdef NUCLEOTIDE_SSSE3
+// Gaps are sparse: runs of 16 without one are copied whole.
+__attribute__((target("ssse3")))
+inline size_t nucleotideStripSsse3(const char *seq, const char *qual, size_t len, char *out, char *qualOut){
+    size_t n = 0;
+    size_t ii = 0;
+    for( ; ii + 16 <= len; ii += 16 ){
+        __m128i v = _mm_loadu_si128((const __m128i*) (seq + ii));
+        if( _mm_movemask_epi8(nucleotideBytes(v)) == 0xffff ){
+            _mm_storeu_si128((__m128i*) (out + n), v);
+            if( qual ){
+                memcpy(qualOut + n, qual + ii, 16);
+            }
+            n += 16;
+        } else {
+            n += nucleotideStripScalar(seq + ii, (qual ? qual + ii : NULL), 16, out + n, (qual ? qualOut + n : NULL));
+        }
+    }
+    return n + nucleotideStripScalar(seq + ii, (qual ? qual + ii : NULL), len - ii, out + n, (qual ? qualOut + n : NULL));
+}
+#endif
+
+inline size_t nucleotideStrip(const char *seq, const char *qual, size_t len, char *out, char *qualOut){
+#ifdef NUCLEOTIDE_SSSE3
+    if( nucleotideSimd() ){
+        return nucleotideStripSsse3(seq, qual, len, out, qualOut);
+    }
+#endif
+    return nucleotideStripScalar(seq, qual, len, out, qualOut);
+}
+
+// Reverse complement
+//   Write the reverse complement of seq to out (which mustn't overlap it).
+//   Case is kept and anything but a nucleotide is only moved.
+inline void nucleotideReverseComplementScalar(const char *seq, size_t len, char *out){
+    static const struct table {
+        char complement[256];
+        table(){
+            for( int ii = 0; ii < 256; ii++ ){
+                complement[ii] = (char) ii;
+            }
+            const char *from = "ATCGatcg";
+            const char *to   = "TAGCtagc";
+            for( int ii = 0; ii < 8; ii++ ){
+                complement[(unsigned char) from[ii]] = to[ii];
+            }
+        }
+    } t;
+
+    for( size_t ii = 0; ii < len; ii++ ){
+        out[ii] = t.complement[(unsigned char) seq[len - 1 - ii]];
+    }
+}
+
+#ifdef NUCLEOTIDE_SSSE3
+__attribute__((target("ssse3")))
+inline void nucleotideReverseComplementSsse3(const char *seq, size_t len, char *out){
+
+    // A <-> T and C <-> G flip fixed bits, keyed by the low nibble
+    __m128i flip    = _mm_setr_epi8(0, 0x15, 0, 0x04, 0x15, 0, 0, 0x04, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    __m128i nibble  = _mm_set1_epi8(0x0f);
+
+    size_t ii = 0;
+    for( ; ii + 16 <= len; ii += 16 ){
+        __m128i v = _mm_loadu_si128((const __m128i*) (seq + len - 16 - ii));
+        __m128i x = _mm_and_si128(nucleotideBytes(v), _mm_shuffle_epi8(flip, _mm_and_si128(v, nibble)));
+        _mm_storeu_si128((__m128i*) (out + ii), _mm_shuffle_epi8(_mm_xor_si128(v, x), reverse));
+    }
+
+    // what's left is the start of seq
+    nucleotideReverseComplementScalar(seq, len - ii, out + ii);
+}
+#endif
+
+inline void nucleotideReverseComplement(const char *seq, size_t len, char *out){
+#ifdef NUCLEOTIDE_SSSE3
+    if( nucleotideSimd() ){
+        nucleotideReverseComplementSsse3(seq, len, out);
+        return;
+    }
+#endif
+    nucleotideReverseComplementScalar(seq, len, out);
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef _PACKED_H_
+#define _PACKED_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/dynamic_bitset.hpp>
+
+#include "nucleotide.h"
+
+// PackedSequence
+//   A nucleotide sequence at two bits per base in 64-bit words, base i in
+//   bits 2i (low bit of its code) and 2i + 1, the same layout as the
+//   dynamic_bitset encodings. A parallel mask holds 11 under A/C/G/T and 00
+//   under gaps, Ns and anything else; masked bases are encoded as A.
+//
+//   Windows of up to 64 bits are read at any bit offset with at most two
+//   word loads, so seeds are compared as masked 64-bit integers.
+
+// Bits [bit, bit + width) of a packed word vector, width <= 64.
+inline uint64_t packedWindow(const std::vector<uint64_t> &words, size_t bit, unsigned int width){
+    size_t w = bit >> 6;
+    unsigned int o = bit & 63;
+    uint64_t v = words[w] >> o;
+    if( o && w + 1 < words.size() ){
+        v |= words[w + 1] << (64 - o);
+    }
+    return (width < 64 ? v & ((1ULL << width) - 1) : v);
+}
+
+// The words of a dynamic_bitset, for windowing.
+inline std::vector<uint64_t> packedWords(const boost::dynamic_bitset<> &b){
+    std::vector<uint64_t> words(b.num_blocks());
+    boost::to_block_range(b, words.begin());
+    return words;
+}
+
+// A dynamic_bitset of the first `bits` bits of a packed word vector.
+inline boost::dynamic_bitset<> packedBits(const std::vector<uint64_t> &words, size_t bits){
+    boost::dynamic_bitset<> b;
+    b.append(words.begin(), words.end());
+    b.resize(bits);
+    return b;
+}
+
+class PackedSequence {
+    public:
+        PackedSequence() : _length(0) {}
+        PackedSequence(const std::string&, const int*);
+        void assign(const char*, size_t, const int*);
+        size_t size() const { return _length; }
+        size_t bits() const { return 2 * _length; }
+        uint64_t window(size_t bit, unsigned int width) const { return packedWindow(_bits, bit, width); }
+        uint64_t maskWindow(size_t bit, unsigned int width) const { return packedWindow(_mask, bit, width); }
+        const std::vector<uint64_t>& getWords() const { return _bits; }
+        const std::vector<uint64_t>& getMaskWords() const { return _mask; }
+        boost::dynamic_bitset<> getBits() const { return packedBits(_bits, bits()); }
+        boost::dynamic_bitset<> getMask() const { return packedBits(_mask, bits()); }
+    private:
+        std::vector<uint64_t> _bits;
+        std::vector<uint64_t> _mask;
+        size_t _length;
+};
+
+// codes[] holds the 2-bit codes of A, T, C and G, in that order.
+inline PackedSequence::PackedSequence(const std::string &seq, const int *codes){
+    assign(seq.data(), seq.size(), codes);
+}
+
+// Pack seq in place of what was held, reusing the words; once they're large
+// enough for the longest sequence seen this doesn't allocate.
+inline void PackedSequence::assign(const char *seq, size_t len, const int *codes){
+    _length = len;
+    _bits.resize((2 * _length + 63) / 64);
+    _mask.resize(_bits.size());
+    if( _length ){
+        nucleotidePack(seq, _length, codes, &_bits[0], &_mask[0]);
+    }
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _PARALLEL_HMM_
+#define _PARALLEL_HMM_
+
+#include <pthread.h>
+
+#include <vector>
+
+// parallelFor
+//   Split [0, n) into `threads` contiguous blocks and run task(begin, end, arg)
+//   on each block in its own pthread. The calling thread runs the first block,
+//   so threads <= 1 never spawns anything.
+typedef void (*ParallelTask)(int, int, void*);
+
+typedef struct {
+    ParallelTask task;
+    int begin;
+    int end;
+    void *arg;
+} parallel_block;
+
+inline void* parallelBlock(void *b){
+    parallel_block *block = (parallel_block*) b;
+    block->task(block->begin, block->end, block->arg);
+    return NULL;
+}
+
+inline void parallelFor(int n, int threads, ParallelTask task, void *arg){
+
+    if( threads > n ){ threads = n; }
+    if( threads <= 1 ){
+        if( n > 0 ){ task(0, n, arg); }
+        return;
+    }
+
+    std::vector<parallel_block> blocks(threads);
+    std::vector<pthread_t> workers(threads);
+
+    for( int ii = 0; ii < threads; ii++ ){
+        blocks[ii].task  = task;
+        blocks[ii].begin = (int) ((long) n * ii / threads);
+        blocks[ii].end   = (int) ((long) n * (ii + 1) / threads);
+        blocks[ii].arg   = arg;
+    }
+
+    for( int ii = 1; ii < threads; ii++ ){
+        pthread_create(&workers[ii], NULL, parallelBlock, &blocks[ii]);
+    }
+
+    parallelBlock(&blocks[0]);
+
+    for( int ii = 1; ii < threads; ii++ ){
+        pthread_join(workers[ii], NULL);
+    }
+}
+
+#endif
@@ -3,8 +3,8 @@
 #ifndef _QUALITY_HMM_
 #define _QUALITY_HMM_
 
-// Log-likeihood error probabilities from phred scores
-double PHRED_TABLE[] = {0.5};
+// Log-likeihood error probabilities from phred scores, defined in hmm.cpp
+extern const double PHRED_TABLE[];
 
 // TODO Replace these stubs
 #define QUAL2LL(X) (1.0)
@@ -12,6 +12,10 @@ double PHRED_TABLE[] = {0.5};
 #define LOGERROR(X) (0.0)
 
 
+// Sanger (phred+33) quality characters
+#define PHRED_OFFSET 33
+#define PHRED2ERROR(Q) (pow(10.0, -(double) (Q) / 10.0))
+
 //default: assume that we're using Sanger reads
 #define LOGQUALITY(X) (PHRED_TABLE[X-33])
 #define LOGQUALITY_SANGER(X) (PHRED_TABLE[X-33])
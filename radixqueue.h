@@ -0,0 +1,113 @@
+#ifndef _RADIXQUEUE_HMM_
+#define _RADIXQUEUE_HMM_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+// RadixQueue
+//   A monotone radix heap over search entries, a drop-in replacement for
+//   std::priority_queue<vsearch<T> > (push, top, pop, empty, size).
+//
+//   Every transition and emission adds a non-positive log-likelihood, so the
+//   likelihoods popped during the search never increase. The queue keys each
+//   entry by its distance -loglikelihood >= 0; the bit pattern of a
+//   non-negative double orders the same way as the double, so the keys are
+//   exact. An entry lives in the bucket of the highest bit in which its key
+//   differs from the last key popped; popping only ever redistributes the
+//   lowest non-empty bucket, giving amortized constant work per entry.
+//
+//   A key that would break monotonicity (a slightly positive log-probability
+//   from rounding) is clamped to the last popped key.
+template <class T>
+class RadixQueue {
+    public:
+        RadixQueue() : _buckets(65), _last(0), _size(0) {}
+        void push(const vsearch<T>&);
+        vsearch<T>& top();
+        void pop();
+        bool empty() const { return _size == 0; }
+        size_t size() const { return _size; }
+    private:
+        typedef std::pair<uint64_t, vsearch<T> > keyed;
+        static uint64_t key(vsearch<T>);
+        static int bucket(uint64_t, uint64_t);
+        void refill();
+        std::vector< std::vector<keyed> > _buckets;
+        uint64_t _last;
+        size_t _size;
+};
+
+template <class T>
+uint64_t RadixQueue<T>::key(vsearch<T> e){
+    double d = 0.0 - e.getEntry()->loglikelihood.v; // 0.0 - 0.0 is +0.0
+    if( d < 0.0 ){
+        d = 0.0;
+    }
+    uint64_t k;
+    memcpy(&k, &d, sizeof(k));
+    return k;
+}
+
+template <class T>
+int RadixQueue<T>::bucket(uint64_t k, uint64_t last){
+    if( k == last ){
+        return 0;
+    }
+    return 64 - __builtin_clzll(k ^ last);
+}
+
+template <class T>
+void RadixQueue<T>::push(const vsearch<T> &e){
+    uint64_t k = key(e);
+    if( k < _last ){
+        k = _last;
+    }
+    _buckets[bucket(k, _last)].push_back(keyed(k, e));
+    _size++;
+}
+
+// Make sure bucket 0 holds the minimum key.
+template <class T>
+void RadixQueue<T>::refill(){
+    if( !_buckets[0].empty() ){
+        return;
+    }
+
+    unsigned int ii = 1;
+    while( _buckets[ii].empty() ){
+        ii++;
+    }
+
+    std::vector<keyed> &from = _buckets[ii];
+    uint64_t least = from[0].first;
+    for( unsigned int jj = 1; jj < from.size(); jj++ ){
+        if( from[jj].first < least ){
+            least = from[jj].first;
+        }
+    }
+
+    // Everything in bucket ii shares the bits above ii with the new minimum,
+    // so it all lands in strictly lower buckets.
+    _last = least;
+    for( unsigned int jj = 0; jj < from.size(); jj++ ){
+        _buckets[bucket(from[jj].first, _last)].push_back(from[jj]);
+    }
+    from.clear();
+}
+
+template <class T>
+vsearch<T>& RadixQueue<T>::top(){
+    refill();
+    return _buckets[0].back().second;
+}
+
+template <class T>
+void RadixQueue<T>::pop(){
+    refill();
+    _buckets[0].pop_back();
+    _size--;
+}
+
+#endif
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "readsim.h"
+
+using namespace std;
+
+// QualityModel
+
+QualityModel::QualityModel(double start, double end, double sd, double correlation){
+    _start = start;
+    _end = end;
+    _sd = sd;
+    _correlation = correlation;
+    assert(_correlation >= 0.0 && _correlation < 1.0);
+}
+
+void QualityModel::draw(MTRand &rng, int len, vector<int> &quals){
+
+    quals.resize(len);
+
+    // scale the innovation so the stationary deviation is _sd
+    double innovation = _sd * sqrt(1.0 - _correlation * _correlation);
+    double deviation = rng.randNorm(0.0, _sd);
+
+    for( int ii = 0; ii < len; ii++ ){
+        double mean = _start;
+        if( len > 1 ){
+            mean += (_end - _start) * ii / (len - 1);
+        }
+
+        int q = (int) floor(mean + deviation + 0.5);
+        if( q < 2 ){ q = 2; }
+        if( q > 41 ){ q = 41; }
+        quals[ii] = q;
+
+        deviation = _correlation * deviation + rng.randNorm(0.0, innovation);
+    }
+}
+
+// ReadSimulator
+
+ReadSimulator::ReadSimulator(HMM *hmm, QualityModel quality, unsigned long seed, double mutation) : _quality(quality) {
+    _hmm = hmm;
+    _seed = seed;
+    _mutation = mutation;
+    assert(_mutation >= 0.0 && _mutation <= 1.0);
+}
+
+static char substitute(char base, MTRand &rng){
+    const char *alphabet;
+    switch( base ){
+        case 'A': alphabet = "CGT"; break;
+        case 'C': alphabet = "AGT"; break;
+        case 'G': alphabet = "ACT"; break;
+        case 'T': alphabet = "ACG"; break;
+        case 'a': alphabet = "cgt"; break;
+        case 'c': alphabet = "agt"; break;
+        case 'g': alphabet = "act"; break;
+        case 't': alphabet = "acg"; break;
+        // Not a nucleotide (e.g. the casino model); leave it alone.
+        default: return base;
+    }
+    return alphabet[rng.randInt(2)];
+}
+
+// Simulate read number `index`. Everything is drawn from the read's own
+// stream, so a read is the same no matter which thread produces it.
+void ReadSimulator::simulate(simulated_read &read, unsigned long index, int length){
+
+    MTRand rng = HMM::seedStream(_seed, index);
+
+    read.path.clear();
+    read.diagonals.clear();
+    read.mutations.clear();
+    read.errors.clear();
+
+    char *seq = _hmm->generate(length, rng, &read.path, &read.diagonals);
+    read.seq = string(seq);
+    free(seq);
+
+    int len = read.seq.size();
+
+    // Mutations happen to the molecule, before it is sequenced.
+    if( _mutation > 0.0 ){
+        for( int ii = 0; ii < len; ii++ ){
+            if( rng.randExc() < _mutation ){
+                char b = substitute(read.seq[ii], rng);
+                if( b != read.seq[ii] ){
+                    read.seq[ii] = b;
+                    read.mutations.push_back(ii);
+                }
+            }
+        }
+    }
+
+    vector<int> quals;
+    _quality.draw(rng, len, quals);
+
+    read.qual.resize(len);
+    for( int ii = 0; ii < len; ii++ ){
+        read.qual[ii] = (char) (quals[ii] + PHRED_OFFSET);
+        if( rng.randExc() < PHRED2ERROR(quals[ii]) ){
+            char b = substitute(read.seq[ii], rng);
+            if( b != read.seq[ii] ){
+                read.seq[ii] = b;
+                read.errors.push_back(ii);
+            }
+        }
+    }
+}
+
+typedef struct {
+    ReadSimulator *simulator;
+    vector<simulated_read> *reads;
+    unsigned long first;
+    int length;
+} simulate_task;
+
+static void simulateBlock(int begin, int end, void *arg){
+    simulate_task *task = (simulate_task*) arg;
+    for( int ii = begin; ii < end; ii++ ){
+        task->simulator->simulate((*task->reads)[ii], task->first + ii, task->length);
+    }
+}
+
+void ReadSimulator::writeTruth(FILE *truth, const char *name, simulated_read &read){
+
+    fprintf(truth, "%s\t", name);
+
+    // state path, run-length encoded
+    unsigned int ii = 0;
+    while( ii < read.path.size() ){
+        unsigned int jj = ii;
+        while( jj < read.path.size() && read.path[jj] == read.path[ii] ){ jj++; }
+        fprintf(truth, "%s%dx%u", (ii ? "," : ""), read.path[ii], jj - ii);
+        ii = jj;
+    }
+
+    // label path; unlabelled states extend the current label
+    fprintf(truth, "\t");
+    string label = "";
+    int first = 0;
+    bool any = false;
+    for( ii = 0; ii <= read.path.size(); ii++ ){
+        string lb = "";
+        if( ii < read.path.size() ){
+            lb = _hmm->getState(read.path[ii])->getLabel();
+        }
+        if( ii == read.path.size() || (lb != "" && lb != label) ){
+            if( label != "" ){
+                fprintf(truth, "%s%s:%d-%d", (any ? "," : ""), label.c_str(), first, ii - 1);
+                any = true;
+            }
+            label = lb;
+            first = ii;
+        }
+    }
+    if( !any ){ fprintf(truth, "-"); }
+
+    fprintf(truth, "\t");
+    for( ii = 0; ii < read.mutations.size(); ii++ ){
+        fprintf(truth, "%s%d", (ii ? "," : ""), read.mutations[ii]);
+    }
+    if( read.mutations.empty() ){ fprintf(truth, "-"); }
+
+    fprintf(truth, "\t");
+    for( ii = 0; ii < read.errors.size(); ii++ ){
+        fprintf(truth, "%s%d", (ii ? "," : ""), read.errors[ii]);
+    }
+    if( read.errors.empty() ){ fprintf(truth, "-"); }
+    fprintf(truth, "\n");
+}
+
+// Write `count` reads to fastq (and truth, if given). Returns the number written.
+long ReadSimulator::write(FILE *fastq, FILE *truth, long count, int length, int threads, int chunk){
+
+    vector<simulated_read> reads(chunk);
+    char name[64];
+
+    simulate_task task;
+    task.simulator = this;
+    task.reads = &reads;
+    task.length = length;
+
+    long written = 0;
+    while( written < count ){
+        int n = (int) (count - written < chunk ? count - written : chunk);
+        task.first = written;
+        parallelFor(n, threads, simulateBlock, &task);
+
+        for( int ii = 0; ii < n; ii++ ){
+            snprintf(name, sizeof(name), "sim.%ld", written + ii);
+            fprintf(fastq, "@%s\n%s\n+\n%s\n", name, reads[ii].seq.c_str(), reads[ii].qual.c_str());
+            if( truth ){
+                writeTruth(truth, name, reads[ii]);
+            }
+        }
+        written += n;
+    }
+
+    return written;
+}
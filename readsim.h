@@ -0,0 +1,57 @@
+#ifndef _READSIM_HMM_
+#define _READSIM_HMM_
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "hmm.h"
+
+// QualityModel
+//   Phred qualities whose mean decays linearly from `start` at the first
+//   base to `end` at the last, with autocorrelated gaussian noise so that
+//   low-quality stretches cluster the way they do on real instruments.
+class QualityModel {
+    public:
+        QualityModel(double start = 37.0, double end = 25.0, double sd = 4.0, double correlation = 0.7);
+        void draw(MTRand&, int, std::vector<int>&);
+    private:
+        double _start;
+        double _end;
+        double _sd;
+        double _correlation;
+};
+
+// One simulated read and its ground truth.
+typedef struct {
+    std::string seq;
+    std::string qual;
+    std::vector<int> path;
+    std::vector<int> diagonals;     // search_band offset of every base
+    std::vector<int> mutations;
+    std::vector<int> errors;
+} simulated_read;
+
+// ReadSimulator
+//   Mutates generated reads uniformly at `mutation` per base, then applies
+//   sequencing errors from the quality model. Streams FASTQ records plus a
+//   tab-separated truth sidecar:
+//     name  state path (id x run length)  label path (label:first-last)
+//     mutated positions  sequencing error positions
+//   Reads are produced in chunks of `chunk` on `threads` workers and written
+//   in order, so memory use is bounded by the chunk, not the dataset.
+class ReadSimulator {
+    public:
+        ReadSimulator(HMM*, QualityModel, unsigned long, double = 0.0);
+        void simulate(simulated_read&, unsigned long, int);
+        long write(FILE*, FILE*, long, int, int = 1, int = 10000);
+    private:
+        void writeTruth(FILE*, const char*, simulated_read&);
+        HMM *_hmm;
+        QualityModel _quality;
+        unsigned long _seed;
+        double _mutation;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "hmm.h"
+#include "locus.h"
+
+using namespace std;
+
+// Annotate reads from several loci at once.
+//
+// Every locus is given by its name, its germline alignment and its compiled
+// model; all the models are loaded up front and stay resident. Each read is
+// classified by its seeds first (see LocusClassifier) and decoded only
+// against the models of the loci it was called to, on the strand it matched;
+// with two candidates the likelier path is kept. Reads no locus is called
+// for are reported as rejected without any Viterbi work.
+//
+// Output is one line per read: its name, locus ('*' if rejected), strand,
+// the seed positions hit and the labels along the path. A summary goes to
+// stderr at the end.
+
+typedef struct {
+    long reads;
+    long rejected;
+    long decoded;     // Viterbi runs, over all candidates
+    vector<long> called;
+} route_counts;
+
+static bool readAlignment(const char *fn, MultipleSequenceAlign &m){
+    gzFile fp = gzopen(fn, "r");
+    if( !fp ){
+        fprintf(stderr, "Could not open %s\n", fn);
+        return false;
+    }
+    kseq_t *seq = kseq_init(fp);
+    while( kseq_read(seq) >= 0 ){
+        m.insert(seq);
+    }
+    kseq_destroy(seq);
+    gzclose(fp);
+    return true;
+}
+
+int main(int argc, char* argv[]){
+
+    if( argc < 5 || (argc - 2) % 3 ){
+        fprintf(stderr, "Usage: %s <reads> <locus> <alignment> <model.xml> [<locus> <alignment> <model.xml>]...\n", argv[0]);
+        return 1;
+    }
+
+    LocusClassifier classifier;
+    vector<HMM*> models;
+    for( int ii = 2; ii < argc; ii += 3 ){
+        MultipleSequenceAlign m;
+        if( !readAlignment(argv[ii + 1], m) ){
+            return 1;
+        }
+        if( access(argv[ii + 2], R_OK) ){
+            fprintf(stderr, "Could not open %s\n", argv[ii + 2]);
+            return 1;
+        }
+        classifier.insert(argv[ii], m);
+        models.push_back(new HMM((const char*) argv[ii + 2]));
+    }
+
+    gzFile fp = gzopen(argv[1], "r");
+    if( !fp ){
+        fprintf(stderr, "Could not open %s\n", argv[1]);
+        return 1;
+    }
+
+    route_counts counts = {0, 0, 0, vector<long>(models.size(), 0)};
+    string forward, seq, qual;
+    kseq_t *read = kseq_init(fp);
+    while( kseq_read(read) >= 0 ){
+        counts.reads++;
+
+        locus_call call;
+        classifier.classify(read->seq.s, read->seq.l, call);
+        if( call.count == 0 ){
+            counts.rejected++;
+            printf("%s\t*\n", read->name.s);
+            continue;
+        }
+
+        seq.assign(read->seq.s, read->seq.l);
+        qual.assign(read->qual.l ? read->qual.s : "", read->qual.l);
+        if( call.reverse ){
+            forward = seq;
+            nucleotideReverseComplement(forward.data(), forward.size(), &seq[0]);
+            reverse(qual.begin(), qual.end());
+        }
+
+        int best = -1;
+        search_stats bestStats;
+        list<string> bestLabels;
+        for( int c = 0; c < call.count; c++ ){
+            search_stats stats;
+            list<string> labels = models[call.locus[c]]->annotate(seq.c_str(), (qual.empty() ? NULL : qual.c_str()), &stats);
+            counts.decoded++;
+            if( stats.found && (best < 0 || stats.loglikelihood > bestStats.loglikelihood) ){
+                best = c;
+                bestStats = stats;
+                bestLabels.swap(labels);
+            }
+        }
+
+        // a read no candidate's model could explain keeps its first call
+        if( best < 0 ){
+            best = 0;
+        }
+        counts.called[call.locus[best]]++;
+
+        printf("%s\t%s\t%c\t%d\t", read->name.s, classifier.getName(call.locus[best]).c_str(), (call.reverse ? '-' : '+'), call.hits[best]);
+        list<string>::iterator lb_itr;
+        for( lb_itr = bestLabels.begin(); lb_itr != bestLabels.end(); lb_itr++ ){
+            printf("%s%s", (lb_itr == bestLabels.begin() ? "" : ","), lb_itr->c_str());
+        }
+        printf("\n");
+    }
+    kseq_destroy(read);
+    gzclose(fp);
+
+    fprintf(stderr, "{\"reads\": %ld, \"rejected\": %ld, \"decoded\": %ld", counts.reads, counts.rejected, counts.decoded);
+    for( int ii = 0; ii < classifier.size(); ii++ ){
+        fprintf(stderr, ", \"%s\": %ld", classifier.getName(ii).c_str(), counts.called[ii]);
+    }
+    fprintf(stderr, "}\n");
+
+    for( unsigned int ii = 0; ii < models.size(); ii++ ){
+        delete models[ii];
+    }
+    return 0;
+}
@@ -0,0 +1,646 @@
+#ifndef _SEEDINDEX_H_
+#define _SEEDINDEX_H_
+
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "packed.h"
+
+// SeedIndex
+//   Finds every seed (a mask and the value under it, over a fixed-width
+//   window) that matches a packed read, in one pass over the read.
+//
+//   Seed masks follow the variable columns of an alignment, so nearly every
+//   seed has a mask of its own and seeds can't be grouped on it. Instead
+//   each seed is anchored on the longest run of contiguous informative bits
+//   in its mask, and filed by the anchor's bits in the table for that run
+//   length. At every bit of the read each table is probed once with the
+//   read's bits there; a candidate found gives the seed's window start in
+//   the read (the probe position less the anchor's offset), where the whole
+//   seed is checked.
+//
+//   A sampled index keeps only seeds that start on a (w,k) minimizer of a
+//   sequence they were found in, filed by that k-mer in a single table. A
+//   read is probed only at its own minimizers, which are those of any
+//   sequence it matches over w + k - 1 bases or more.
+//
+//   Most probes find nothing. Each table keeps a blocked Bloom filter over
+//   its keys, a cache line per key, so that a probe for a key it doesn't
+//   hold is turned away with one access, and the table's own slots (32
+//   bytes each, at a load of at most one half) are only walked for keys
+//   that are probably there.
+
+// SeedPattern
+//   The shape of the seeds taken from an alignment: a window of bases, each
+//   either counted ('1') or skipped ('0'), and the fewest informative bits a
+//   seed needs. Contiguous seeds are all ones. A pattern starts and ends on
+//   a counted base and is at most 32 bases. Written as a string, it may be
+//   followed by ":n" to set the minimum, then by "/w,k" to sample seeds by
+//   (w,k) minimizers (k at most 32).
+class SeedPattern {
+    public:
+        SeedPattern(const std::string& = "111111111111", unsigned int = 1);
+        bool valid() const { return _width > 0; }
+        unsigned int width() const { return _width; }
+        uint64_t care() const { return _care; }
+        unsigned int minimum() const { return _minimum; }
+        bool sampled() const { return _window > 0; }
+        unsigned int window() const { return _window; }
+        unsigned int kmer() const { return _kmer; }
+        const std::string& getPattern() const { return _pattern; }
+    private:
+        std::string _pattern;
+        unsigned int _width;   // bits
+        uint64_t _care;        // 11 under counted bases
+        unsigned int _minimum;
+        unsigned int _window;  // 0 when every seed is kept
+        unsigned int _kmer;
+};
+
+inline SeedPattern::SeedPattern(const std::string &spec, unsigned int minimum){
+    _width = 0;
+    _care = 0;
+    _minimum = minimum;
+    _window = 0;
+    _kmer = 0;
+
+    size_t slash = spec.find('/');
+    if( slash != std::string::npos ){
+        if( sscanf(spec.c_str() + slash + 1, "%u,%u", &_window, &_kmer) != 2 || _window < 1 || _kmer < 1 || _kmer > 32 ){
+            return;
+        }
+    }
+
+    std::string shape = spec.substr(0, slash);
+    size_t colon = shape.find(':');
+    _pattern = shape.substr(0, colon);
+    if( colon != std::string::npos ){
+        _minimum = atoi(shape.c_str() + colon + 1);
+    }
+    if( _pattern.empty() || _pattern.size() > 32 || _pattern[0] != '1' || _pattern[_pattern.size() - 1] != '1' ){
+        return;
+    }
+    for( unsigned int ii = 0; ii < _pattern.size(); ii++ ){
+        if( _pattern[ii] == '1' ){
+            _care |= 3ULL << (2 * ii);
+        } else if( _pattern[ii] != '0' ){
+            _care = 0;
+            return;
+        }
+    }
+    _width = 2 * _pattern.size();
+}
+
+// Anchor widths, one table each. A seed is anchored on the widest of these
+// that fits in its longest run.
+static const unsigned int SEED_ANCHORS[] = {1, 2, 4, 6, 8, 12, 16};
+#define SEED_ANCHOR_COUNT 7
+
+typedef struct {
+    uint64_t key;   // the anchor's bits
+    uint64_t mask;
+    uint64_t value;
+    int shift;      // the anchor's offset in the seed window
+    int id;         // -1 marks an empty slot
+} seed_slot;
+
+typedef struct {
+    int position;   // bit offset of the seed window in the read
+    int id;
+} seed_hit;
+
+// A table as written to a file: its anchor width, how many seeds it holds,
+// how many slots and how many filter blocks (its own, in the file's slots
+// and filters sections, after those of the tables before it).
+typedef struct {
+    uint32_t anchor;
+    uint32_t used;
+    uint64_t slots;
+    uint64_t filterBlocks;
+} seed_table_info;
+
+// SeedFilter
+//   A blocked Bloom filter over 64-bit keys: each key sets one bit in each
+//   of the eight words of one 64-byte block, so a lookup reads a single
+//   cache line. At SEED_FILTER_BITS bits per key about one absent key in
+//   a few hundred gets through.
+#define SEED_FILTER_BITS 16
+#define SEED_FILTER_WORDS 8
+
+class SeedFilter {
+    public:
+        SeedFilter() : _data(NULL), _blocks(0) {}
+        SeedFilter(const SeedFilter &rhs){ copy(rhs); }
+        SeedFilter& operator=(const SeedFilter &rhs){ if( this != &rhs ){ copy(rhs); } return *this; }
+        void build(const seed_slot*, size_t, size_t);
+        void map(const uint64_t*, size_t);
+        inline bool contains(uint64_t) const;
+        static size_t blocksFor(size_t);
+        const uint64_t* words() const { return _data; }
+        size_t blocks() const { return _blocks; }
+        size_t bytes() const { return 8 * SEED_FILTER_WORDS * _blocks; }
+    private:
+        static inline uint64_t hash(uint64_t);
+        inline const uint64_t* block(uint64_t) const;
+        void allocate(size_t);
+        void copy(const SeedFilter&);
+        // the blocks, at _data: a block's worth over in _words, so that
+        // they can start on a 64-byte boundary (a copy has buffers of its
+        // own, aligned afresh), or in a mapped file
+        std::vector<uint64_t> _words;
+        const uint64_t *_data;
+        size_t _blocks;
+};
+
+// Counts of the probes a SeedIndex has made: those the filters let
+// through, and of those the ones whose key was in the table.
+typedef struct {
+    long probes;
+    long passed;
+    long found;
+} seed_probe_counts;
+
+class SeedTable {
+    public:
+        SeedTable(unsigned int);
+        SeedTable(const seed_table_info&, const seed_slot*, const uint64_t*, int);
+        void insert(const seed_slot&);
+        inline bool match(const PackedSequence&, unsigned int, uint64_t, int, std::vector<seed_hit>&) const;
+        bool filter(uint64_t key) const { return _filter.contains(key); }
+        void buildFilter(){ _filter.build(slots(), capacity(), _used); }
+        uint64_t getProbe() const { return _probe; }
+        unsigned int size() const { return _used; }
+        size_t capacity() const { return (_mapped ? _mappedSize : _slots.size()); }
+        size_t filterBytes() const { return _filter.bytes(); }
+        const SeedFilter& getFilter() const { return _filter; }
+        const seed_slot* slots() const { return (_mapped ? _mapped : &_slots[0]); }
+    private:
+        inline size_t slot(uint64_t) const;
+        void grow();
+        uint64_t _probe;
+        std::vector<seed_slot> _slots;
+        unsigned int _used;
+        SeedFilter _filter;
+        // or, for a table in a mapped file, its slots there, and the ids
+        // its seeds can have (what's there isn't checked when it's mapped)
+        const seed_slot *_mapped;
+        size_t _mappedSize;
+        int _ids;
+};
+
+class SeedIndex {
+    public:
+        SeedIndex() : _width(0), _window(0), _kmer(0) { resetCounts(); }
+        void sample(unsigned int, unsigned int);
+        void insert(uint64_t, uint64_t, unsigned int, int);
+        void insert(uint64_t, uint64_t, unsigned int, int, uint64_t);
+        void match(const PackedSequence&, std::vector<seed_hit>&);
+        size_t size() const { return _seeds.size(); }
+        const std::vector<seed_slot>& seeds() const { return _seeds; }
+        size_t tables(){ index(); return _tables.size(); }
+        unsigned int width() const { return _width; }
+        unsigned int window() const { return _window; }
+        unsigned int kmer() const { return _kmer; }
+        size_t bytes();
+        const seed_probe_counts& counts() const { return _counts; }
+        void resetCounts(){ _counts.probes = _counts.passed = _counts.found = 0; }
+        void flatten(std::vector<seed_table_info>&, std::vector<seed_slot>&, std::vector<uint64_t>&);
+        bool map(unsigned int, const seed_table_info*, size_t, const seed_slot*, size_t, const uint64_t*, size_t, int);
+    private:
+        void index();
+        std::vector<seed_slot> _seeds;
+        std::vector<SeedTable> _tables; // built on demand, cleared by insert
+        unsigned int _width;
+        // minimizer sampling, when _window isn't 0, and the read's
+        // minimizers, kept between reads
+        unsigned int _window;
+        unsigned int _kmer;
+        std::vector<int> _starts;
+        seed_probe_counts _counts;
+};
+
+// Minimizers
+//   K-mers are ordered by a mix of their bits, so that the least of a window
+//   is as good as random rather than the one with the most As.
+inline uint64_t minimizerOrder(uint64_t kmer){
+    kmer ^= kmer >> 31;
+    kmer *= 0x7fb5d329728ea185ULL;
+    kmer ^= kmer >> 27;
+    kmer *= 0x81dadef4bc2dd44dULL;
+    return kmer ^ (kmer >> 33);
+}
+
+// The bit offsets of the (w,k) minimizers of seq: of every w consecutive
+// k-mers, the least, the leftmost of equals. K-mers over a masked base are
+// never chosen, and a sequence of fewer than w k-mers has its least.
+inline void minimizers(const PackedSequence &seq, unsigned int w, unsigned int k, std::vector<int> &starts){
+    starts.clear();
+    if( seq.size() < k ){
+        return;
+    }
+
+    int n = seq.size() - k + 1;
+    unsigned int bits = 2 * k;
+    uint64_t full = (bits < 64 ? (1ULL << bits) - 1 : ~0ULL);
+    int best = -1;
+    uint64_t bestOrder = ~0ULL;
+
+    for( int end = 0; end < n; end++ ){
+        int begin = end - (int) w + 1;
+        if( best < begin ){
+            // the least has left the window; find the next
+            best = -1;
+            bestOrder = ~0ULL;
+            for( int ii = (begin > 0 ? begin : 0); ii <= end; ii++ ){
+                if( seq.maskWindow(2 * ii, bits) == full ){
+                    uint64_t order = minimizerOrder(seq.window(2 * ii, bits));
+                    if( best < 0 || order < bestOrder ){
+                        best = ii;
+                        bestOrder = order;
+                    }
+                }
+            }
+        } else if( seq.maskWindow(2 * end, bits) == full ){
+            uint64_t order = minimizerOrder(seq.window(2 * end, bits));
+            if( best < 0 || order < bestOrder ){
+                best = end;
+                bestOrder = order;
+            }
+        }
+
+        if( best >= 0 && (begin >= 0 || end == n - 1) && (starts.empty() || starts.back() != 2 * best) ){
+            starts.push_back(2 * best);
+        }
+    }
+}
+
+// SeedFilter
+// Zeroed room for n blocks, and where the first starts.
+inline void SeedFilter::allocate(size_t n){
+    _blocks = n;
+    _words.assign(SEED_FILTER_WORDS * (_blocks + 1), 0);
+    uintptr_t base = (uintptr_t) &_words[0];
+    _data = &_words[(((base + 63) & ~(uintptr_t) 63) - base) / sizeof(uint64_t)];
+}
+
+// A copy of mapped blocks maps them too.
+inline void SeedFilter::copy(const SeedFilter &rhs){
+    if( rhs._words.empty() ){
+        map(rhs._data, rhs._blocks);
+        return;
+    }
+    allocate(rhs._blocks);
+    memcpy((uint64_t*) _data, rhs._data, SEED_FILTER_WORDS * _blocks * sizeof(uint64_t));
+}
+
+// Read n blocks written from words(), which have to outlive the filter.
+inline void SeedFilter::map(const uint64_t *words, size_t n){
+    _words.clear();
+    _data = words;
+    _blocks = n;
+}
+
+// The blocks for used keys.
+inline size_t SeedFilter::blocksFor(size_t used){
+    size_t blocks = (used * SEED_FILTER_BITS + 64 * SEED_FILTER_WORDS - 1) / (64 * SEED_FILTER_WORDS);
+    return (blocks ? blocks : 1);
+}
+
+// Build over the keys of the used slots; empty slots are skipped.
+inline void SeedFilter::build(const seed_slot *slots, size_t n, size_t used){
+    allocate(blocksFor(used));
+
+    for( size_t ii = 0; ii < n; ii++ ){
+        if( slots[ii].id < 0 ){
+            continue;
+        }
+        uint64_t h = hash(slots[ii].key);
+        uint64_t *b = (uint64_t*) block(h);
+        for( int w = 0; w < SEED_FILTER_WORDS; w++ ){
+            b[w] |= 1ULL << ((h >> (6 * w)) & 63);
+        }
+    }
+}
+
+// Not the minimizer order itself: the keys of a sampled table are the
+// k-mers that order made least, and would crowd the first blocks.
+inline uint64_t SeedFilter::hash(uint64_t key){
+    return minimizerOrder(key ^ 0x5bd1e9955bd1e995ULL);
+}
+
+// The block for hash h, chosen by its high bits; its low 48 pick the bits.
+inline const uint64_t* SeedFilter::block(uint64_t h) const {
+    size_t b = (size_t) (((h >> 48) * (uint64_t) _blocks) >> 16);
+    return _data + SEED_FILTER_WORDS * b;
+}
+
+inline bool SeedFilter::contains(uint64_t key) const {
+    if( _blocks == 0 ){
+        return true;
+    }
+    uint64_t h = hash(key);
+    const uint64_t *b = block(h);
+    uint64_t all = ~0ULL;
+    for( int w = 0; w < SEED_FILTER_WORDS; w++ ){
+        all &= b[w] >> ((h >> (6 * w)) & 63);
+    }
+    return all & 1;
+}
+
+// SeedTable
+inline SeedTable::SeedTable(unsigned int width){
+    _probe = (width < 64 ? (1ULL << width) - 1 : ~0ULL);
+    seed_slot empty = {0, 0, 0, 0, -1};
+    _slots.resize(8, empty);
+    _used = 0;
+    _mapped = NULL;
+    _mappedSize = 0;
+    _ids = INT_MAX;
+}
+
+// A table read straight from its slots and filter blocks in a mapped file,
+// for seed ids under ids; it can't be inserted into.
+inline SeedTable::SeedTable(const seed_table_info &info, const seed_slot *slots, const uint64_t *filter, int ids){
+    _probe = (info.anchor < 64 ? (1ULL << info.anchor) - 1 : ~0ULL);
+    _used = info.used;
+    _mapped = slots;
+    _mappedSize = info.slots;
+    _ids = ids;
+    _filter.map(filter, info.filterBlocks);
+}
+
+inline size_t SeedTable::slot(uint64_t key) const {
+    return (size_t) ((key * 0x9e3779b97f4a7c15ULL) >> 32) & (capacity() - 1);
+}
+
+inline void SeedTable::insert(const seed_slot &s){
+    assert( !_mapped );
+
+    // keep the load under one half
+    if( 2 * (_used + 1) > _slots.size() ){
+        grow();
+    }
+
+    size_t ii = slot(s.key);
+    while( _slots[ii].id >= 0 ){
+        ii = (ii + 1) & (_slots.size() - 1);
+    }
+    _slots[ii] = s;
+    _used++;
+}
+
+inline void SeedTable::grow(){
+    std::vector<seed_slot> slots;
+    slots.swap(_slots);
+
+    seed_slot empty = {0, 0, 0, 0, -1};
+    _slots.resize(2 * slots.size(), empty);
+    _used = 0;
+    for( unsigned int ii = 0; ii < slots.size(); ii++ ){
+        if( slots[ii].id >= 0 ){
+            insert(slots[ii]);
+        }
+    }
+}
+
+// Check the seeds anchored on key, read at bit pos, against their whole
+// window. Returns whether any seed has that key. A probe stops after every
+// slot, and seeds with ids out of range are passed over, so that a damaged
+// file can't hold a read up or send its hits out of bounds.
+inline bool SeedTable::match(const PackedSequence &read, unsigned int width, uint64_t key, int pos, std::vector<seed_hit> &hits) const {
+    const seed_slot *slots = this->slots();
+    size_t last = capacity() - 1;
+    bool found = false;
+    size_t ii = slot(key);
+    for( size_t n = 0; n <= last && slots[ii].id >= 0; n++, ii = (ii + 1) & last ){
+        const seed_slot &s = slots[ii];
+        if( s.key != key || s.id >= _ids ){
+            continue;
+        }
+        found = true;
+        if( pos < s.shift || pos - s.shift + width > read.bits() ){
+            continue;
+        }
+        int start = pos - s.shift;
+        if( (read.window(start, width) & s.mask) == s.value && (s.mask & ~read.maskWindow(start, width)) == 0 ){
+            seed_hit h = {start, s.id};
+            hits.push_back(h);
+        }
+    }
+    return found;
+}
+
+// SeedIndex
+// Sample seeds by (w,k) minimizers; seeds are then inserted with the k-mer
+// they're filed by.
+inline void SeedIndex::sample(unsigned int w, unsigned int k){
+    assert( _seeds.empty() && k >= 1 && k <= 32 );
+    _window = w;
+    _kmer = k;
+}
+
+// Seeds are windows of width bits (all of one width); value is taken
+// under mask.
+inline void SeedIndex::insert(uint64_t mask, uint64_t value, unsigned int width, int id){
+    assert( !_window );
+    assert( _seeds.size() || _tables.empty() ); // not a mapped index
+    assert( _seeds.empty() || width == _width );
+    _width = width;
+
+    seed_slot s = {0, mask, value & mask, 0, id};
+    _seeds.push_back(s);
+    _tables.clear();
+}
+
+// A seed of a sampled index, found on a minimizer whose k-mer is key. The
+// same seed may be found on several.
+inline void SeedIndex::insert(uint64_t mask, uint64_t value, unsigned int width, int id, uint64_t key){
+    assert( _window && (_seeds.size() || _tables.empty()) );
+    assert( _seeds.empty() || width == _width );
+    _width = width;
+
+    seed_slot s = {key, mask, value & mask, 0, id};
+    _seeds.push_back(s);
+    _tables.clear();
+}
+
+static inline bool bySlotKey(const seed_slot &lhs, const seed_slot &rhs){
+    return lhs.key < rhs.key || (lhs.key == rhs.key && lhs.id < rhs.id);
+}
+
+inline void SeedIndex::index(){
+
+    if( _tables.size() || _seeds.empty() ){
+        return;
+    }
+
+    // one table, by minimizer, each seed once under each of its k-mers
+    if( _window ){
+        std::vector<seed_slot> seeds = _seeds;
+        std::sort(seeds.begin(), seeds.end(), bySlotKey);
+        _tables.push_back(SeedTable(2 * _kmer));
+        for( unsigned int ii = 0; ii < seeds.size(); ii++ ){
+            if( ii == 0 || bySlotKey(seeds[ii - 1], seeds[ii]) ){
+                _tables[0].insert(seeds[ii]);
+            }
+        }
+        _tables[0].buildFilter();
+        return;
+    }
+
+    for( int ii = 0; ii < SEED_ANCHOR_COUNT; ii++ ){
+        _tables.push_back(SeedTable(SEED_ANCHORS[ii]));
+    }
+
+    for( unsigned int ii = 0; ii < _seeds.size(); ii++ ){
+        seed_slot s = _seeds[ii];
+
+        // the longest run of informative bits
+        int run = 0, best = 0, shift = 0;
+        for( unsigned int b = 0; b < _width; b++ ){
+            run = ((s.mask >> b) & 1 ? run + 1 : 0);
+            if( run > best ){
+                best = run;
+                shift = b + 1 - run;
+            }
+        }
+
+        // a seed without informative bits matches everywhere; it's of no use
+        if( best == 0 ){
+            continue;
+        }
+
+        int t = SEED_ANCHOR_COUNT - 1;
+        while( (int) SEED_ANCHORS[t] > best ){
+            t--;
+        }
+
+        s.shift = shift;
+        s.key = (s.value >> shift) & _tables[t].getProbe();
+        _tables[t].insert(s);
+    }
+
+    // drop the tables nothing was anchored in
+    std::vector<SeedTable> used;
+    for( unsigned int ii = 0; ii < _tables.size(); ii++ ){
+        if( _tables[ii].size() ){
+            used.push_back(_tables[ii]);
+            used.back().buildFilter();
+        }
+    }
+    _tables.swap(used);
+}
+
+// Append a hit for every seed matching the read, for every place it does.
+inline void SeedIndex::match(const PackedSequence &read, std::vector<seed_hit> &hits){
+    index();
+
+    if( _tables.empty() || read.bits() < _width ){
+        return;
+    }
+
+    if( _window ){
+        minimizers(read, _window, _kmer, _starts);
+        const SeedTable &t = _tables[0];
+        for( unsigned int ii = 0; ii < _starts.size(); ii++ ){
+            uint64_t key = read.window(_starts[ii], 2 * _kmer);
+            _counts.probes++;
+            if( t.filter(key) ){
+                _counts.passed++;
+                _counts.found += t.match(read, _width, key, _starts[ii], hits);
+            }
+        }
+        return;
+    }
+
+    for( unsigned int pos = 0; pos < read.bits(); pos++ ){
+        uint64_t val  = read.window(pos, 64);
+        uint64_t mask = read.maskWindow(pos, 64);
+
+        std::vector<SeedTable>::const_iterator t_itr;
+        for( t_itr = _tables.begin(); t_itr != _tables.end(); t_itr++ ){
+            uint64_t probe = t_itr->getProbe();
+            if( (mask & probe) != probe ){
+                continue;
+            }
+            _counts.probes++;
+            if( t_itr->filter(val & probe) ){
+                _counts.passed++;
+                _counts.found += t_itr->match(read, _width, val & probe, pos, hits);
+            }
+        }
+    }
+}
+
+// The memory the tables and their filters take.
+inline size_t SeedIndex::bytes(){
+    index();
+
+    size_t n = 0;
+    std::vector<SeedTable>::const_iterator t_itr;
+    for( t_itr = _tables.begin(); t_itr != _tables.end(); t_itr++ ){
+        n += t_itr->capacity() * sizeof(seed_slot) + t_itr->filterBytes();
+    }
+    return n;
+}
+
+// The tables, laid out to be written to a file: one entry each, and all
+// their slots and filter blocks one table after another.
+inline void SeedIndex::flatten(std::vector<seed_table_info> &info, std::vector<seed_slot> &slots, std::vector<uint64_t> &filters){
+    index();
+
+    info.clear();
+    slots.clear();
+    filters.clear();
+    std::vector<SeedTable>::const_iterator t_itr;
+    for( t_itr = _tables.begin(); t_itr != _tables.end(); t_itr++ ){
+        const SeedFilter &f = t_itr->getFilter();
+        seed_table_info i = {(uint32_t) __builtin_popcountll(t_itr->getProbe()), t_itr->size(), t_itr->capacity(), f.blocks()};
+        info.push_back(i);
+        slots.insert(slots.end(), t_itr->slots(), t_itr->slots() + t_itr->capacity());
+        filters.insert(filters.end(), f.words(), f.words() + SEED_FILTER_WORDS * f.blocks());
+    }
+}
+
+// Read the tables straight out of the slots and filter blocks written by
+// flatten, which have to outlive the index, for seed ids under ids. Only
+// the sizes are checked, so that mapping costs the same whatever the size
+// of the index: each table needs a power of two slots, fewer seeds than
+// slots and the blocks its filter was built with, and the tables have to
+// add up to what's there. The slots themselves are trusted; match guards
+// against any that are damaged.
+inline bool SeedIndex::map(unsigned int width, const seed_table_info *info, size_t tables, const seed_slot *slots, size_t count, const uint64_t *filters, size_t words, int ids){
+    _seeds.clear();
+    _tables.clear();
+    _width = width;
+
+    size_t used = 0, blocks = 0;
+    for( size_t ii = 0; ii < tables; ii++ ){
+        if( info[ii].anchor < 1 || info[ii].anchor > 64 || info[ii].slots == 0 ||
+            (info[ii].slots & (info[ii].slots - 1)) || info[ii].used >= info[ii].slots ||
+            info[ii].slots > count - used ||
+            info[ii].filterBlocks != SeedFilter::blocksFor(info[ii].used) ||
+            info[ii].filterBlocks > (words / SEED_FILTER_WORDS) - blocks ){
+            _tables.clear();
+            return false;
+        }
+        _tables.push_back(SeedTable(info[ii], slots + used, filters + SEED_FILTER_WORDS * blocks, ids));
+        used += info[ii].slots;
+        blocks += info[ii].filterBlocks;
+    }
+    if( used != count || SEED_FILTER_WORDS * blocks != words ){
+        _tables.clear();
+        return false;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "readsim.h"
+
+using namespace std;
+
+int main(int argc, char* argv[]){
+
+    if( argc < 5 ){
+        fprintf(stderr, "Usage: %s <model.xml> <reads> <length> <out prefix> [seed] [threads] [mutation rate]\n", argv[0]);
+        return 1;
+    }
+
+    HMM h((const char*) argv[1]);
+    long count = atol(argv[2]);
+    int length = atoi(argv[3]);
+    unsigned long seed = (argc > 5 ? strtoul(argv[5], NULL, 10) : 0);
+    int threads = (argc > 6 ? atoi(argv[6]) : 1);
+    double mutation = (argc > 7 ? atof(argv[7]) : 0.0);
+
+    string prefix(argv[4]);
+    FILE *fastq = fopen((prefix + ".fastq").c_str(), "w");
+    FILE *truth = fopen((prefix + ".truth").c_str(), "w");
+    if( !fastq || !truth ){
+        fprintf(stderr, "Could not open %s.fastq / %s.truth for writing\n", argv[4], argv[4]);
+        return 1;
+    }
+
+    ReadSimulator sim(&h, QualityModel(), seed, mutation);
+    long n = sim.write(fastq, truth, count, length, threads);
+    fprintf(stderr, "Wrote %ld reads\n", n);
+
+    fclose(fastq);
+    fclose(truth);
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include "stats.h"
+
+#ifdef HMM_STATS
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+using namespace std;
+
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static vector<search_counters*> statsThreads;
+static __thread search_counters *statsMine = NULL;
+static volatile sig_atomic_t statsRequested = 0;
+
+static void statsSignal(int){
+    // Only flag the request; the dump itself happens on the next poll in
+    // any thread, outside of signal context. The handler may run in any
+    // thread too, so the flag is atomic.
+    __atomic_store_n(&statsRequested, 1, __ATOMIC_RELAXED);
+}
+
+// Installed before main, so a SIGUSR1 sent before the first search is a
+// request rather than the default's kill. Defined after statsThreads, so
+// the dump at exit runs before that is destroyed.
+static struct stats_installer {
+    stats_installer(){
+        signal(SIGUSR1, statsSignal);
+        atexit(hmmStatsDump);
+    }
+} statsInstaller;
+
+search_counters* hmmStatsLocal(){
+    if( statsMine ){
+        return statsMine;
+    }
+
+    statsMine = new search_counters();
+    statsMine->searches = 0;
+    statsMine->pushes = 0;
+    statsMine->pops = 0;
+    statsMine->duplicates = 0;
+    statsMine->pruned = 0;
+    statsMine->allocated = 0;
+    statsMine->peakQueue = 0;
+
+    pthread_mutex_lock(&statsLock);
+    statsThreads.push_back(statsMine);
+    pthread_mutex_unlock(&statsLock);
+
+    return statsMine;
+}
+
+// The vector only grows under the lock, which the dump holds while it
+// reads, so it isn't moved from under it.
+void hmmStatsExpand(int id){
+    search_counters *c = hmmStatsLocal();
+    if( (int) c->expansions.size() <= id ){
+        pthread_mutex_lock(&statsLock);
+        c->expansions.resize(id + 1, 0);
+        pthread_mutex_unlock(&statsLock);
+    }
+    hmmStatsAdd(&c->expansions[id], 1);
+}
+
+void hmmStatsPeak(long n){
+    search_counters *c = hmmStatsLocal();
+    if( n > __atomic_load_n(&c->peakQueue, __ATOMIC_RELAXED) ){
+        __atomic_store_n(&c->peakQueue, n, __ATOMIC_RELAXED);
+    }
+}
+
+// Called once per search, in every thread; the first to see SIGUSR1 since
+// the last dump makes it.
+void hmmStatsPoll(){
+    hmmStatsAdd(&hmmStatsLocal()->searches, 1);
+    if( __atomic_load_n(&statsRequested, __ATOMIC_RELAXED) && __sync_bool_compare_and_swap(&statsRequested, 1, 0) ){
+        hmmStatsDump();
+    }
+}
+
+void hmmStatsDump(){
+
+    search_counters total;
+    total.searches = total.pushes = total.pops = 0;
+    total.duplicates = total.pruned = total.allocated = total.peakQueue = 0;
+
+    pthread_mutex_lock(&statsLock);
+    vector<search_counters*>::iterator t_itr;
+    for( t_itr = statsThreads.begin(); t_itr != statsThreads.end(); t_itr++ ){
+        search_counters *c = *t_itr;
+        total.searches   += __atomic_load_n(&c->searches, __ATOMIC_RELAXED);
+        total.pushes     += __atomic_load_n(&c->pushes, __ATOMIC_RELAXED);
+        total.pops       += __atomic_load_n(&c->pops, __ATOMIC_RELAXED);
+        total.duplicates += __atomic_load_n(&c->duplicates, __ATOMIC_RELAXED);
+        total.pruned     += __atomic_load_n(&c->pruned, __ATOMIC_RELAXED);
+        total.allocated  += __atomic_load_n(&c->allocated, __ATOMIC_RELAXED);
+        total.peakQueue = max(total.peakQueue, __atomic_load_n(&c->peakQueue, __ATOMIC_RELAXED));
+        if( total.expansions.size() < c->expansions.size() ){
+            total.expansions.resize(c->expansions.size(), 0);
+        }
+        for( unsigned int ii = 0; ii < c->expansions.size(); ii++ ){
+            total.expansions[ii] += __atomic_load_n(&c->expansions[ii], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&statsLock);
+
+    FILE *out = stderr;
+    const char *fn = getenv("HMM_STATS_FILE");
+    if( fn && !(out = fopen(fn, "a")) ){
+        out = stderr;
+    }
+
+    fprintf(out, "{\"searches\": %ld, \"pushes\": %ld, \"pops\": %ld, \"duplicate_pops\": %ld, "
+                 "\"pruned\": %ld, \"nodes_allocated\": %ld, \"peak_queue\": %ld, \"expansions\": {",
+            total.searches, total.pushes, total.pops, total.duplicates, total.pruned, total.allocated, total.peakQueue);
+
+    bool first = true;
+    for( unsigned int ii = 0; ii < total.expansions.size(); ii++ ){
+        if( total.expansions[ii] ){
+            fprintf(out, "%s\"%u\": %ld", (first ? "" : ", "), ii, total.expansions[ii]);
+            first = false;
+        }
+    }
+    fprintf(out, "}}\n");
+
+    if( out != stderr ){
+        fclose(out);
+    } else {
+        fflush(out);
+    }
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef _STATS_HMM_
+#define _STATS_HMM_
+
+// Search instrumentation
+//   Build with STATS=YES (-DHMM_STATS) to count what the Viterbi search does:
+//   queue pushes and pops, pops discarded as already searched, candidates
+//   pruned before the push as dominated, nodes allocated, the deepest queue
+//   seen and how often each state was expanded.
+//   Counters are kept per thread and summed when dumped as JSON, one line
+//   a dump, at exit and whenever the process receives SIGUSR1 (handled
+//   from startup on). The output goes to stderr, or is appended to the
+//   file named by HMM_STATS_FILE.
+//   Only its own thread writes a counter, but the dump reads them all while
+//   the searches run, so they're read and written as relaxed atomics: a
+//   dump is a consistent count per counter, not a snapshot of them all.
+//   The signal only flags the request; the dump is made by the first
+//   search to finish after it, in any thread, so it waits at most one
+//   search, or until one is next run, or until exit.
+//
+//   Without HMM_STATS every macro below expands to nothing.
+
+#ifdef HMM_STATS
+
+#include <vector>
+
+typedef struct {
+    long searches;
+    long pushes;
+    long pops;
+    long duplicates;
+    long pruned;
+    long allocated;
+    long peakQueue;
+    std::vector<long> expansions; // indexed by state id
+} search_counters;
+
+search_counters* hmmStatsLocal();
+void hmmStatsExpand(int);
+void hmmStatsPeak(long);
+void hmmStatsPoll();
+void hmmStatsDump();
+
+// Add to a counter of the calling thread's. A plain load and store is
+// enough with no other writer; atomic, so a dump can read it meanwhile.
+inline void hmmStatsAdd(long *counter, long n){
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+#define HMM_STAT(field, n)     hmmStatsAdd(&hmmStatsLocal()->field, (n))
+#define HMM_STAT_EXPAND(id)    hmmStatsExpand(id)
+#define HMM_STAT_PEAK(n)       hmmStatsPeak(n)
+#define HMM_STAT_POLL()        hmmStatsPoll()
+
+#else
+
+#define HMM_STAT(field, n)     ((void) 0)
+#define HMM_STAT_EXPAND(id)    ((void) 0)
+#define HMM_STAT_PEAK(n)       ((void) 0)
+#define HMM_STAT_POLL()        ((void) 0)
+
+#endif
+
+#endif